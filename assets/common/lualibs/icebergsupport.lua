@@ -99,15 +99,9 @@ t.group_command = function(...) -- {{{
 end -- }}}
 
 t.process_shortcut_keys = function() -- {{{
-  local accept = 0
-  for i,v in ipairs(shortcuts) do
-    t.bind_key(v.key, function()
-      t.do_autocomplete()
-      t.default_after_command_action(t.command_execute(v.name, {t.get_input_text()}))
-      accept = 1
-    end)
-  end
-  return accept
+  -- shortcuts are dispatched by iceberg before on_key_down is called.
+  -- this function is kept for compatibility with older configurations.
+  return 0
 end -- }}}
 
 t.execute = function(cmd) -- {{{
@@ -210,19 +210,13 @@ shortcuts = {
   { key = "ctrl-l", name = ":cd" }
 }
 
-function on_key_up()
-  local accept = 0
-  return accept
-end
-
-function on_key_down()
-  local accept = 0
-  if accept == 0 then
-    accept = ibs.process_shortcut_keys() 
-  end
-
-  return accept
-end
+-- on_key_up and on_key_down are not defined, so key events are handled
+-- without calling Lua. define them if you need them:
+--
+-- function on_key_down()
+--   local accept = 0
+--   return accept
+-- end
 
 function on_enter()
   local accept = 0
@@ -8,6 +8,13 @@
 #include "ib_icon_manager.h"
 #include "ib_singleton.h"
 
+// class CompletionValue {{{
+Fl_Image* ib::CompletionValue::loadIcon(const int size) { // {{{
+  ib::IconRequest request(size);
+  getIconRequest(request);
+  return ib::Singleton<ib::IconManager>::getInstance()->loadIcon(request);
+} // }}}
+// }}}
 
 // class CompletionPathParts {{{
 ib::CompletionPathParts::CompletionPathParts(const char *dirname, const char *basename) : dirname_(dirname), basename_(basename), description_(""), path_("") {
@@ -32,8 +39,8 @@ bool ib::CompletionPathParts::isAutocompleteEnable() const { // {{{
   return ib::Singleton<ib::Config>::getInstance()->getPathAutocomplete();
 } // }}}
 
-Fl_Image* ib::CompletionPathParts::loadIcon(const int size) { // {{{
-  return ib::Singleton<ib::IconManager>::getInstance()->getAssociatedIcon(path_.c_str(), size);
+void ib::CompletionPathParts::getIconRequest(ib::IconRequest &request) const { // {{{
+  request.setAssociatedIcon(path_);
 } // }}}
 // }}}
 
@@ -46,22 +53,17 @@ bool ib::CompletionString::isAutocompleteEnable() const { // {{{
   return ib::Singleton<ib::Config>::getInstance()->getOptionAutocomplete();
 } // }}}
 
-Fl_Image* ib::CompletionString::loadIcon(const int size) { // {{{
+void ib::CompletionString::getIconRequest(ib::IconRequest &request) const { // {{{
   ib::oschar ospath[IB_MAX_PATH];
   if(icon_file_.empty()){
     ib::platform::utf82oschar_b(ospath, IB_MAX_PATH, value_.c_str());
     if(ib::platform::is_path(ospath)){
-      return ib::Singleton<ib::IconManager>::getInstance()->getAssociatedIcon(value_.c_str(), size);
-    }else{
-      return nullptr;
+      request.setAssociatedIcon(value_);
     }
   }else{
-    ib::oschar ospath[IB_MAX_PATH];
     ib::platform::utf82oschar_b(ospath, IB_MAX_PATH, icon_file_.c_str());
     if(ib::platform::is_path(ospath)){
-      return ib::Singleton<ib::IconManager>::getInstance()->getImgFileIcon(icon_file_.c_str(), size);
-    }else{
-      return nullptr;
+      request.setImgFileIcon(icon_file_);
     }
   }
 } // }}}
@@ -117,12 +119,11 @@ const std::string* ib::Command::getContextMenuPath() const { // {{{
   return &getCommandPath();
 } // }}}
 
-Fl_Image* ib::Command::loadIcon(const int size) { // {{{
-  auto icon_manager = ib::Singleton<ib::IconManager>::getInstance();
+void ib::Command::getIconRequest(ib::IconRequest &request) const { // {{{
   if(icon_file_.empty()){
-    return icon_manager->getAssociatedIcon(command_path_.c_str(), size);
+    request.setAssociatedIcon(command_path_);
   }else{
-    return icon_manager->getImgFileIcon(icon_file_.c_str(), size);
+    request.setImgFileIcon(icon_file_);
   }
 } // }}}
 
@@ -194,12 +195,11 @@ const std::string* ib::LuaFunctionCommand::getContextMenuPath() const { // {{{
   return nullptr;
 } // }}}
 
-Fl_Image* ib::LuaFunctionCommand::loadIcon(const int size) { // {{{
-  auto icon_manager = ib::Singleton<ib::IconManager>::getInstance();
+void ib::LuaFunctionCommand::getIconRequest(ib::IconRequest &request) const { // {{{
   if(icon_file_.empty()){
-    return icon_manager->getLuaIcon(size);
+    request.setLuaIcon();
   }else{
-    return icon_manager->getImgFileIcon(icon_file_.c_str(), size);
+    request.setImgFileIcon(icon_file_);
   }
 } // }}}
 
@@ -289,11 +289,12 @@ const std::string* ib::HistoryCommand::getContextMenuPath() const { // {{{
   return &command_path_;
 } // }}}
 
-Fl_Image* ib::HistoryCommand::loadIcon(const int size) { // {{{
+void ib::HistoryCommand::getIconRequest(ib::IconRequest &request) const { // {{{
   if(org_cmd_){
-    return org_cmd_->loadIcon(size);
+    org_cmd_->getIconRequest(request);
+    return;
   }
-  return ib::Singleton<ib::IconManager>::getInstance()->getAssociatedIcon(command_path_.c_str(), size);
+  request.setAssociatedIcon(command_path_);
 } // }}}
 // }}}
 
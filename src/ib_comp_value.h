@@ -5,6 +5,7 @@
 #include "ib_utils.h"
 
 namespace ib{
+  class IconRequest;
   class CompletionValue : private NonCopyable<CompletionValue> { // {{{
     public:
       virtual ~CompletionValue() {};
@@ -15,7 +16,10 @@ namespace ib{
       virtual bool isAutocompleteEnable() const { return false; }
       virtual bool hasDescription() const { return false;}
       virtual const std::string* getContextMenuPath() const = 0;
-      virtual Fl_Image* loadIcon(const int size){ return nullptr; }
+      // fills the request with the icon of this value. The request must
+      // not refer to this value, since icons are loaded without the listbox lock.
+      virtual void getIconRequest(ib::IconRequest &request) const {}
+      Fl_Image* loadIcon(const int size);
   }; // }}}
 
   class CompletionPathParts : public CompletionValue { // {{{
@@ -29,7 +33,7 @@ namespace ib{
       const std::string& getDescription() const { return description_; }
       const std::string* getContextMenuPath() const;
       bool isAutocompleteEnable() const;
-      Fl_Image* loadIcon(const int size);
+      void getIconRequest(ib::IconRequest &request) const;
 
     protected:
       std::string dirname_;
@@ -56,7 +60,7 @@ namespace ib{
       void setIconFile(const std::string &value){ icon_file_ = value; }
       void setIconFile(const char *value){ icon_file_ = value; }
       bool isAutocompleteEnable() const;
-      Fl_Image* loadIcon(const int size);
+      void getIconRequest(ib::IconRequest &request) const;
 
     protected:
       std::string value_;
@@ -140,7 +144,7 @@ namespace ib{
 
       /* virtual methods */
       const std::string* getContextMenuPath() const;
-      Fl_Image* loadIcon(const int size);
+      void getIconRequest(ib::IconRequest &request) const;
       int execute(const std::vector<std::string*> &args, const std::string* workdir, ib::Error &error);
       void init();
 
@@ -162,7 +166,7 @@ namespace ib{
 
       /* virtual methods */
       const std::string* getContextMenuPath() const;
-      Fl_Image* loadIcon(const int size);
+      void getIconRequest(ib::IconRequest &request) const;
 
       void init();
       int execute(const std::vector<std::string*> &args, const std::string* workdir, ib::Error &error);
@@ -170,7 +174,7 @@ namespace ib{
 
   class HistoryCommand : public BaseCommand { // {{{
     public:
-      HistoryCommand() : BaseCommand(), org_cmd_(nullptr), command_path_(), times_(), raw_score_(0), initialized_(false) {}
+      HistoryCommand() : BaseCommand(), org_cmd_(nullptr), command_path_(), times_(), raw_score_(0.0), recency_(0), initialized_(false) {}
 
       /* virtual methods */
       const std::string& getCompvalue() const { return path_; }
@@ -178,22 +182,27 @@ namespace ib{
       void init();
       int execute(const std::vector<std::string*> &args, const std::string* workdir, ib::Error &error);
       const std::string* getContextMenuPath() const;
-      Fl_Image* loadIcon(const int size);
+      void getIconRequest(ib::IconRequest &request) const;
 
-      int getRawScore() const { return raw_score_; }
-      void setRawScore(const int value){ raw_score_ = value; }
+      double getRawScore() const { return raw_score_; }
+      void setRawScore(const double value){ raw_score_ = value; }
+      // a larger value means this command was executed more recently.
+      std::size_t getRecency() const { return recency_; }
+      void setRecency(const std::size_t value){ recency_ = value; }
 
       BaseCommand* getOriginalCommand() const { return org_cmd_;}
 
       const std::vector<std::time_t>& getTimes() const { return times_; }
       void setTimes(const std::vector<std::time_t> &value){ times_ = value; }
       void addTime(const std::time_t value) { times_.push_back(value); }
+      void removeOldestTime() { times_.erase(times_.begin()); }
 
     protected:
       BaseCommand *org_cmd_;
       std::string command_path_;
       std::vector<std::time_t> times_;
-      int raw_score_;
+      double raw_score_;
+      std::size_t recency_;
       bool        initialized_;
   }; // }}}
 
@@ -15,18 +15,22 @@ void ib::Completer::completeHistory(std::vector<ib::CompletionValue*> &candidate
 
   auto history = ib::Singleton<ib::History>::getInstance();
 
-  const auto &commands = history->getOrderedCommands();
   const auto average = history->getAverageScore();
   const auto se     = history->calcScoreSe();
-  std::map<std::string, bool> found;
-  for(auto it = commands.rbegin(), last = commands.rend(); it != last; ++it){
-    auto cmd = (*it);
-    if(method_history_->match(cmd->getPath(), value) > -1){
-      if(found.find(cmd->getPath()) == found.end()){
-        cmd->setScore(history->calcScore(cmd->getPath(), average, se));
+  std::vector<ib::HistoryCommand*> indexed;
+  if(!method_history_->isRegexMatch() && history->findCandidates(indexed, method_history_->getType(), value)){
+    for(auto &cmd : indexed){
+      if(method_history_->match(cmd->getPath(), value) > -1){
+        cmd->setScore(history->calcScore(cmd, average, se));
+        candidates.push_back(cmd);
+      }
+    }
+  }else{
+    for(auto &cmd : history->getRecentCommands()){
+      if(method_history_->match(cmd->getPath(), value) > -1){
+        cmd->setScore(history->calcScore(cmd, average, se));
         candidates.push_back(cmd);
       }
-      found[cmd->getPath()] = true;
     }
   }
 
@@ -34,24 +38,108 @@ void ib::Completer::completeHistory(std::vector<ib::CompletionValue*> &candidate
 
 } // }}}
 
+int ib::Completer::getOptionCacheTtl(const std::string &name) const { // {{{
+  auto it = option_cache_ttls_.find(name);
+  if(it == option_cache_ttls_.end()) return 0;
+  return (*it).second;
+} // }}}
+
+void ib::Completer::invalidateOptionCache(const std::string &name) { // {{{
+  for(auto it = option_caches_.begin(); it != option_caches_.end();){
+    if((*it).second.getCommand() == name){
+      it = option_caches_.erase(it);
+    }else{
+      ++it;
+    }
+  }
+} // }}}
+
+void ib::Completer::matchOptionCandidates(std::vector<ib::CompletionValue*> &candidates, const std::vector<ib::OptionCandidate> &options, const std::string &input, const bool is_value_token) { // {{{
+  for(const auto &option : options) {
+    const auto &value = option.getValue();
+    if(option.isAlwaysMatch() || !is_value_token || method_option_->match(value, input) > -1){
+      ib::CompletionString *compstr = new ib::CompletionString(value.c_str());
+      compstr->setDescription(option.getDescription());
+      compstr->setIconFile(option.getIconFile());
+      if(option.isAlwaysMatch()) {
+        if(is_value_token) {
+          compstr->setCompvalue(input.c_str());
+        }else {
+          compstr->setCompvalue(value.c_str());
+        }
+      }
+      candidates.push_back(compstr);
+    }
+  }
+} // }}}
+
+static void _resume_option_completion_fd(FL_SOCKET fd, void *data) { // {{{
+  ib::Singleton<ib::Completer>::getInstance()->resumeOptionCompletion(true);
+} // }}}
+
+static void _resume_option_completion_timeout(void *data) { // {{{
+  ib::Singleton<ib::Completer>::getInstance()->resumeOptionCompletion(false);
+} // }}}
+
+static void _read_option_candidates(std::vector<ib::OptionCandidate> &options, lua_State *L, const int index) { // {{{
+  for(int i = 1;;i++){
+    lua_pushinteger(L, i); 
+    lua_gettable(L, index); 
+    if(lua_isnil(L, -1)){
+      lua_pop(L, 1);
+      break;
+    }
+    switch(lua_type(L, -1)) {
+      case LUA_TSTRING:
+        options.push_back(ib::OptionCandidate(lua_tostring(L, -1)));
+        break;
+
+      case LUA_TTABLE: {
+          lua_getfield(L, -1, "value");
+          if(!lua_isstring(L, -1)){
+            lua_pop(L, 1);
+            break;
+          }
+          ib::OptionCandidate option(lua_tostring(L, -1));
+          lua_pop(L, 1);
+          lua_getfield(L, -1, "always_match");
+          option.setIsAlwaysMatch(lua_toboolean(L, -1) != 0);
+          lua_pop(L, 1);
+
+          lua_getfield(L, -1, "description");
+          if(lua_isstring(L, -1)){
+            option.setDescription(lua_tostring(L, -1));
+          }
+          lua_pop(L, 1);
+
+          lua_getfield(L, -1, "icon");
+          if(lua_isstring(L, -1)){
+            option.setIconFile(lua_tostring(L, -1));
+          }
+          lua_pop(L, 1);
+          options.push_back(option);
+        }
+        break;
+
+      default:
+        ;
+    }
+    lua_pop(L, 1);
+  }
+} // }}}
+
 void ib::Completer::completeOption(std::vector<ib::CompletionValue*> &candidates, const std::string &command) { // {{{
+  cancelOptionCompletion();
   if(!hasCompletionFunc(command)) return;
   auto maininput = ib::Singleton<ib::MainWindow>::getInstance()->getInput();
-  const auto &input = maininput->getCursorValue();
+  const auto input = maininput->getCursorValue();
   const auto &tokens = maininput->getTokens();
   const auto token = maininput->getCursorToken();
   const unsigned int position = maininput->position();
   method_option_->beforeMatch(candidates, input);
-  
-  const auto start = lua_gettop(IB_LUA);
-  lua_getglobal(IB_LUA, "system");
-  lua_getfield(IB_LUA, -1, "completer");
-  lua_getfield(IB_LUA, -1, "option_func");
-  lua_getfield(IB_LUA, -1, command.c_str());
-  lua_newtable(IB_LUA);
-  const auto top = lua_gettop(IB_LUA);
-  int i = 1;
-  int current_index = 1;
+
+  std::vector<ib::StringView> args;
+  unsigned int current_index = 1;
   unsigned int token_index = 1; // 0 is command name
   for(; token_index < tokens.size(); token_index++){
     const auto token = tokens.at(token_index);
@@ -59,91 +147,182 @@ void ib::Completer::completeOption(std::vector<ib::CompletionValue*> &candidates
     const auto is_last = (tokens.size() - 1 == token_index);
 
     if(token->isValueToken()) {
-      lua_pushinteger(IB_LUA, i);
-      lua_pushstring(IB_LUA, token->getValue().c_str());
-      lua_settable(IB_LUA, top);
-      if(is_current) current_index = i;
-      i++;
+      args.push_back(token->getValue());
+      if(is_current) current_index = args.size();
     } else if(is_current){
-      current_index = i;
+      current_index = args.size() + 1;
       if(is_last){
-        lua_pushinteger(IB_LUA, i);
-        lua_pushstring(IB_LUA, "");
-        lua_settable(IB_LUA, top);
-        i++;
+        args.push_back(ib::StringView());
       }
     }
   }
 
-  lua_pushinteger(IB_LUA, current_index);
-  if(lua_pcall(IB_LUA, 2, 1, 0) != 0){
-    ib::utils::message_box("%s", lua_tostring(IB_LUA, lua_gettop(IB_LUA)));
-    return;
+  // results are cached per command and preceding arguments, so keystrokes
+  // that only change the current argument are filtered without calling Lua.
+  std::string cache_key;
+  if(getOptionCacheTtl(command) > 0) {
+    cache_key = command;
+    cache_key += '\0';
+    for(unsigned int j = 0; j < current_index - 1; j++){
+      cache_key += args.at(j);
+      cache_key += '\0';
+    }
+    auto it = option_caches_.find(cache_key);
+    if(it != option_caches_.end() && !(*it).second.isExpired(std::chrono::steady_clock::now())){
+      matchOptionCandidates(candidates, (*it).second.getCandidates(), input, token->isValueToken());
+      method_option_->afterMatch(candidates, input);
+      return;
+    }
   }
 
-  if(!lua_istable(IB_LUA, -1)) {
-    ib::utils::message_box("Completion function must return a table, but got a(n) %s", lua_typename(IB_LUA, lua_type(IB_LUA, -1)));
-    return;
+  // completion functions run as a coroutine, so they can yield partial
+  // results without blocking the UI.
+  option_job_ = new ib::OptionCompletionJob(command, cache_key, maininput->value());
+  const auto start = lua_gettop(IB_LUA);
+  auto thread = lua_newthread(IB_LUA);
+  option_job_->setThread(thread, luaL_ref(IB_LUA, LUA_REGISTRYINDEX));
+  lua_getglobal(IB_LUA, "system");
+  lua_getfield(IB_LUA, -1, "completer");
+  lua_getfield(IB_LUA, -1, "option_func");
+  lua_getfield(IB_LUA, -1, command.c_str());
+  lua_newtable(IB_LUA);
+  const auto top = lua_gettop(IB_LUA);
+  int i = 1;
+  for(const auto &arg : args){
+    lua_pushinteger(IB_LUA, i);
+    lua_pushlstring(IB_LUA, arg.data(), arg.size());
+    lua_settable(IB_LUA, top);
+    i++;
   }
+  lua_pushinteger(IB_LUA, current_index);
+  lua_xmove(IB_LUA, thread, 3);
+  lua_pop(IB_LUA, lua_gettop(IB_LUA) - start);
 
-  for(i = 1;;i++){
-    lua_pushinteger(IB_LUA, i); 
-    lua_gettable(IB_LUA, -2); 
-    if(lua_isnil(IB_LUA, -1)){
-      lua_pop(IB_LUA, 1);
-      break;
+  runOptionCompletion(candidates, input, token->isValueToken(), 2);
+  method_option_->afterMatch(candidates, input);
+} // }}}
+
+int ib::Completer::runOptionCompletion(std::vector<ib::CompletionValue*> &candidates, const std::string &input, const bool is_value_token, const int nargs) { // {{{
+  auto job = option_job_;
+  auto thread = job->getThread();
+  job->setRunning(true);
+  const auto status = lua_resume(thread, nargs);
+  job->setRunning(false);
+  // the job may have been cancelled by the completion function itself
+  if(job->isCancelled()) {
+    deleteOptionJob(job);
+    return -1;
+  }
+  if(status != 0 && status != LUA_YIELD){
+    ib::utils::message_box("%s", lua_tostring(thread, -1));
+    cancelOptionCompletion();
+    return -1;
+  }
+
+  // a yielded result can be nil if nothing is found yet
+  if(status == 0 || !lua_isnoneornil(thread, 1)){
+    if(!lua_istable(thread, 1)) {
+      ib::utils::message_box("Completion function must return a table, but got a(n) %s", lua_typename(thread, lua_type(thread, 1)));
+      cancelOptionCompletion();
+      return -1;
     }
-    switch(lua_type(IB_LUA, -1)) {
-      case LUA_TSTRING: {
-          const auto value = luaL_checkstring(IB_LUA, -1);
-          if(!token->isValueToken() || method_option_->match(value, input) > -1){
-            candidates.push_back(new ib::CompletionString(value));
-          }
+    _read_option_candidates(option_job_->getOptions(), thread, 1);
+  }
+  matchOptionCandidates(candidates, option_job_->getOptions(), input, is_value_token);
+
+  if(status == 0){
+    const auto ttl = getOptionCacheTtl(option_job_->getCommand());
+    if(ttl > 0) {
+      const auto now = std::chrono::steady_clock::now();
+      for(auto it = option_caches_.begin(); it != option_caches_.end();){
+        if((*it).second.isExpired(now)){
+          it = option_caches_.erase(it);
+        }else{
+          ++it;
         }
-        break;
+      }
+      auto &cache = option_caches_[option_job_->getCacheKey()];
+      cache.setCommand(option_job_->getCommand());
+      cache.setExpires(now + std::chrono::milliseconds(ttl));
+      cache.getCandidates().swap(option_job_->getOptions());
+    }
+    cancelOptionCompletion();
+    return 0;
+  }
 
-      case LUA_TTABLE: {
-          lua_getfield(IB_LUA, -1, "value");
-          const auto value = luaL_checkstring(IB_LUA, -1);
-          lua_pop(IB_LUA, 1);
-          lua_getfield(IB_LUA, -1, "always_match");
-          const auto is_always_match = lua_toboolean(IB_LUA, -1);
-          lua_pop(IB_LUA, 1);
-
-          if(is_always_match || !token->isValueToken() || method_option_->match(value, input) > -1){
-            ib::CompletionString *compstr = new ib::CompletionString(value);
-
-            lua_getfield(IB_LUA, -1, "description");
-            if(!lua_isnil(IB_LUA, -1)){
-              compstr->setDescription(luaL_checkstring(IB_LUA, -1));
-            }
-            lua_pop(IB_LUA, 1);
-
-            lua_getfield(IB_LUA, -1, "icon");
-            if(!lua_isnil(IB_LUA, -1)){
-              compstr->setIconFile(luaL_checkstring(IB_LUA, -1));
-            }
-            lua_pop(IB_LUA, 1);
-            if(is_always_match) {
-              if(token->isValueToken()) {
-                compstr->setCompvalue(input.c_str());
-              }else {
-                compstr->setCompvalue(value);
-              }
-            }
-            candidates.push_back(compstr);
-          }
-        }
-        break;
+  // coroutine.yield(partial_results, {fd = fd, timeout = seconds})
+  double timeout = -1.0;
+  if(lua_isnumber(thread, 2)){
+    timeout = lua_tonumber(thread, 2);
+  }else if(lua_istable(thread, 2)){
+    lua_getfield(thread, 2, "fd");
+    if(lua_isnumber(thread, -1)) option_job_->setFd((int)lua_tointeger(thread, -1));
+    lua_pop(thread, 1);
+    lua_getfield(thread, 2, "timeout");
+    if(lua_isnumber(thread, -1)) timeout = lua_tonumber(thread, -1);
+    lua_pop(thread, 1);
+  }
+  lua_settop(thread, 0);
+  if(option_job_->getFd() < 0 && timeout < 0.0) timeout = 0.0;
 
-      default:
-        ;
-    }
-    lua_pop(IB_LUA, 1);
+  if(option_job_->getFd() > -1) {
+    Fl::add_fd((FL_SOCKET)option_job_->getFd(), FL_READ, _resume_option_completion_fd, 0);
+  }
+  if(timeout > -1.0) {
+    Fl::add_timeout(timeout, _resume_option_completion_timeout, 0);
+  }
+  return LUA_YIELD;
+} // }}}
+
+void ib::Completer::resumeOptionCompletion(const bool fd_ready) { // {{{
+  if(option_job_ == nullptr) return;
+  if(option_job_->getFd() > -1) {
+    Fl::remove_fd((FL_SOCKET)option_job_->getFd(), FL_READ);
+    option_job_->setFd(-1);
+  }
+  Fl::remove_timeout(_resume_option_completion_timeout, 0);
+
+  const auto main_window = ib::Singleton<ib::MainWindow>::getInstance();
+  auto maininput = main_window->getInput();
+  if(!main_window->visible() || option_job_->getInputText() != maininput->value()) {
+    cancelOptionCompletion();
+    return;
+  }
+
+  const auto input = maininput->getCursorValue();
+  std::vector<ib::CompletionValue*> candidates;
+  method_option_->beforeMatch(candidates, input);
+  lua_pushboolean(option_job_->getThread(), fd_ready);
+  if(runOptionCompletion(candidates, input, maininput->getCursorToken()->isValueToken(), 1) < 0) {
+    ib::utils::delete_pointer_vectors(candidates);
+    return;
   }
- 
-  lua_pop(IB_LUA, lua_gettop(IB_LUA) - start);
   method_option_->afterMatch(candidates, input);
+
+  ib::Singleton<ib::ListWindow>::getInstance()->getListbox()->startUpdate();
+  ib::Singleton<ib::Controller>::getInstance()->updateCompletionCandidates(candidates, false);
+} // }}}
+
+void ib::Completer::cancelOptionCompletion() { // {{{
+  if(option_job_ == nullptr) return;
+  if(option_job_->getFd() > -1) {
+    Fl::remove_fd((FL_SOCKET)option_job_->getFd(), FL_READ);
+  }
+  Fl::remove_timeout(_resume_option_completion_timeout, 0);
+  auto job = option_job_;
+  option_job_ = nullptr;
+  // the running coroutine must not be collected until lua_resume returns.
+  if(job->isRunning()) {
+    job->setCancelled(true);
+    return;
+  }
+  deleteOptionJob(job);
+} // }}}
+
+void ib::Completer::deleteOptionJob(ib::OptionCompletionJob *job) { // {{{
+  // an abandoned coroutine is collected by the Lua GC
+  luaL_unref(IB_LUA, LUA_REGISTRYINDEX, job->getRef());
+  delete job;
 } // }}}
 
 void ib::Completer::completePath(std::vector<ib::CompletionValue*> &candidates, const std::string &value) { // {{{
@@ -238,7 +417,8 @@ void ib::CompletionMethodMigemoMixin::beforeMatch(std::vector<ib::CompletionValu
   auto migemo = ib::Singleton<ib::Migemo>::getInstance();
   if(migemo->isEnable() && input.size() >= ib::Migemo::MIN_LENGTH){
     const auto pattern = migemo->query((unsigned char*)input.c_str());
-    regex_ = new ib::Regex((char*)pattern, ib::Regex::NONE);
+    // migemo patterns change on every keystroke.
+    regex_ = new ib::Regex((char*)pattern, ib::Regex::NONE, false);
     migemo->release(pattern);
 
     if(regex_->init() != 0){
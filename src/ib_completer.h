@@ -17,6 +17,9 @@ namespace ib {
       CompletionMethod(){}
       virtual ~CompletionMethod(){}
 
+      virtual int    getType() const { return 0; }
+      // returns true if match uses a regular expression instead of the input.
+      virtual bool   isRegexMatch() const { return false; }
       virtual void   beforeMatch(std::vector<ib::CompletionValue*> &candidates, const std::string &input){};
       virtual double match(const std::string &name, const std::string &input){return 0.0;};
       virtual void   afterMatch(std::vector<ib::CompletionValue*> &candidates, const std::string &input){};
@@ -26,6 +29,7 @@ namespace ib {
     public:
       CompletionMethodMigemoMixin() : CompletionMethod(), regex_(nullptr) {}
       virtual ~CompletionMethodMigemoMixin() { if(regex_ != nullptr) delete regex_; }
+      bool  isRegexMatch() const { return regex_ != nullptr; }
       void  beforeMatch(std::vector<ib::CompletionValue*> &candidates, const std::string &input);
       double match(const std::string &name, const std::string &input);
       void  afterMatch(std::vector<ib::CompletionValue*> &candidates, const std::string &input);
@@ -39,6 +43,7 @@ namespace ib {
       BeginsWithMatchCompletionMethod() : CompletionMethodMigemoMixin() {}
       ~BeginsWithMatchCompletionMethod() {}
 
+      int getType() const { return BEGINS_WITH; }
       double match(const std::string &name, const std::string &input);
   }; // }}}
 
@@ -47,6 +52,7 @@ namespace ib {
       PartialMatchCompletionMethod() : CompletionMethodMigemoMixin() {}
       ~PartialMatchCompletionMethod() {}
 
+      int getType() const { return PARTIAL; }
       double match(const std::string &name, const std::string &input);
   }; // }}}
 
@@ -55,11 +61,87 @@ namespace ib {
       AbbrMatchCompletionMethod() : CompletionMethod() {}
       ~AbbrMatchCompletionMethod() {}
 
+      int getType() const { return ABBR; }
       void  beforeMatch(std::vector<ib::CompletionValue*> &candidates, const std::string &input);
       double match(const std::string &name, const std::string &input);
       void  afterMatch(std::vector<ib::CompletionValue*> &candidates, const std::string &input);
   }; // }}}
 
+  class OptionCandidate { // {{{
+    public:
+      OptionCandidate(const std::string &value) : value_(value), description_(""), icon_file_(""), is_always_match_(false) {}
+
+      const std::string& getValue() const { return value_; }
+      const std::string& getDescription() const { return description_; }
+      void setDescription(const char *value) { description_ = value; }
+      const std::string& getIconFile() const { return icon_file_; }
+      void setIconFile(const char *value) { icon_file_ = value; }
+      bool isAlwaysMatch() const { return is_always_match_; }
+      void setIsAlwaysMatch(const bool value) { is_always_match_ = value; }
+
+    protected:
+      std::string value_;
+      std::string description_;
+      std::string icon_file_;
+      bool is_always_match_;
+  }; // }}}
+
+  // Results of an option completion function. Results are reused while
+  // the preceding arguments are unchanged and the entry is not expired.
+  class OptionCache { // {{{
+    public:
+      OptionCache() : command_(), expires_(), candidates_() {}
+
+      const std::string& getCommand() const { return command_; }
+      void setCommand(const std::string &value) { command_ = value; }
+      bool isExpired(const std::chrono::steady_clock::time_point &now) const { return now >= expires_; }
+      void setExpires(const std::chrono::steady_clock::time_point &value) { expires_ = value; }
+      std::vector<ib::OptionCandidate>& getCandidates() { return candidates_; }
+      const std::vector<ib::OptionCandidate>& getCandidates() const { return candidates_; }
+
+    protected:
+      std::string command_;
+      std::chrono::steady_clock::time_point expires_;
+      std::vector<ib::OptionCandidate> candidates_;
+  }; // }}}
+
+  // A completion function that is running as a Lua coroutine.
+  // Completion functions can yield partial results and are resumed
+  // when the given fd becomes readable or the given timeout expires.
+  class OptionCompletionJob : private NonCopyable<OptionCompletionJob> { // {{{
+    public:
+      OptionCompletionJob(const std::string &command, const std::string &cache_key, const std::string &input_text) : command_(command), cache_key_(cache_key), input_text_(input_text), thread_(nullptr), ref_(LUA_NOREF), fd_(-1), options_(), is_running_(false), is_cancelled_(false) {}
+      ~OptionCompletionJob() {}
+
+      const std::string& getCommand() const { return command_; }
+      const std::string& getCacheKey() const { return cache_key_; }
+      const std::string& getInputText() const { return input_text_; }
+      lua_State* getThread() const { return thread_; }
+      int getRef() const { return ref_; }
+      void setThread(lua_State *thread, const int ref) { thread_ = thread; ref_ = ref; }
+      int getFd() const { return fd_; }
+      void setFd(const int value) { fd_ = value; }
+      std::vector<ib::OptionCandidate>& getOptions() { return options_; }
+      // true while the coroutine is being resumed.
+      bool isRunning() const { return is_running_; }
+      void setRunning(const bool value) { is_running_ = value; }
+      // a job cancelled while it is running is deleted after the
+      // coroutine returns.
+      bool isCancelled() const { return is_cancelled_; }
+      void setCancelled(const bool value) { is_cancelled_ = value; }
+
+    protected:
+      std::string command_;
+      std::string cache_key_;
+      std::string input_text_;
+      lua_State *thread_;
+      int ref_;
+      int fd_;
+      std::vector<ib::OptionCandidate> options_;
+      bool is_running_;
+      bool is_cancelled_;
+  }; // }}}
+
   class Completer : public NonCopyable<Completer> {
     friend class ib::Singleton<ib::Completer>;
     public:
@@ -68,6 +150,7 @@ namespace ib {
         if(method_option_ != nullptr) delete method_option_;
         if(method_path_ != nullptr) delete method_path_;
         if(method_command_ != nullptr) delete method_command_;
+        if(option_job_ != nullptr) delete option_job_;
       }
 
       void setOptionFuncFlag(const std::string &name) { option_func_flags_.insert(name); }
@@ -75,6 +158,12 @@ namespace ib {
       bool hasCompletionFunc(const std::string &name) const {
         return option_func_flags_.find(name) != option_func_flags_.end(); 
       }
+      void setOptionCacheTtl(const std::string &name, const int ms) { option_cache_ttls_[name] = ms; }
+      int getOptionCacheTtl(const std::string &name) const;
+      void invalidateOptionCache(const std::string &name);
+      void invalidateOptionCache() { option_caches_.clear(); }
+      void resumeOptionCompletion(const bool fd_ready);
+      void cancelOptionCompletion();
 
       virtual void completeHistory(std::vector<ib::CompletionValue*> &candidates, const std::string &command);
 
@@ -97,13 +186,20 @@ namespace ib {
       void setMethodCommand( ib::CompletionMethod * value){ method_command_ = value; }
 
     protected:
+      int runOptionCompletion(std::vector<ib::CompletionValue*> &candidates, const std::string &input, const bool is_value_token, const int nargs);
+      void deleteOptionJob(ib::OptionCompletionJob *job);
+      void matchOptionCandidates(std::vector<ib::CompletionValue*> &candidates, const std::vector<ib::OptionCandidate> &options, const std::string &input, const bool is_value_token);
+
       std::unordered_set<std::string> option_func_flags_;
+      std::unordered_map<std::string, int> option_cache_ttls_;
+      std::unordered_map<std::string, ib::OptionCache> option_caches_;
+      ib::OptionCompletionJob *option_job_;
       CompletionMethod *method_history_;
       CompletionMethod *method_option_;
       CompletionMethod *method_path_;
       CompletionMethod *method_command_;
 
-      Completer(): option_func_flags_(), method_history_(nullptr), method_option_(nullptr),
+      Completer(): option_func_flags_(), option_cache_ttls_(), option_caches_(), option_job_(nullptr), method_history_(nullptr), method_option_(nullptr),
                    method_path_(nullptr), method_command_(nullptr) {}
 
 
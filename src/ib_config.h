@@ -5,6 +5,7 @@
 #include "ib_utils.h"
 #include "ib_search_path.h"
 #include "ib_completer.h"
+#include "ib_key_bindings.h"
 #include "ib_singleton.h"
 
 namespace ib {
@@ -30,6 +31,15 @@ namespace ib {
       unsigned int getMaxCachedIcons() const { return max_cached_icons_; }
       void setMaxCachedIcons(const unsigned int value){ max_cached_icons_ = value; }
 
+      unsigned int getIconCacheBytes() const { return icon_cache_bytes_; }
+      void setIconCacheBytes(const unsigned int value){ icon_cache_bytes_ = value; }
+
+      bool getIconCacheCompression() const { return icon_cache_compression_; }
+      void setIconCacheCompression(const bool value){ icon_cache_compression_ = value; }
+
+      unsigned int getIconLoaderThreads() const { return icon_loader_threads_; }
+      void setIconLoaderThreads(const unsigned int value){ icon_loader_threads_ = value; }
+
       unsigned int getKeyEventThreshold() const { return key_event_threshold_; }
       void setKeyEventThreshold(const unsigned int value){ key_event_threshold_ = value; }
 
@@ -92,6 +102,15 @@ namespace ib {
       const int* getKillWordKey() const { return kill_word_key_; }
       void setKillWordKey(const int *value){ memcpy(kill_word_key_, value, sizeof(int)*3); }
 
+      const ib::KeyBindings& getKeyBindings() const { return key_bindings_; }
+      ib::KeyBindings& getKeyBindings() { return key_bindings_; }
+
+      bool getEnableKeyUpHandler() const { return enable_key_up_handler_; }
+      void setEnableKeyUpHandler(const bool value){ enable_key_up_handler_ = value; }
+
+      bool getEnableKeyDownHandler() const { return enable_key_down_handler_; }
+      void setEnableKeyDownHandler(const bool value){ enable_key_down_handler_ = value; }
+
       Fl_Boxtype getStyleWindowBoxtype() const { return style_window_boxtype_; }
       void setStyleWindowBoxtype(const Fl_Boxtype value){ style_window_boxtype_ = value; }
 
@@ -225,6 +244,10 @@ namespace ib {
       void setIconCachePath(const std::string & value){ icon_cache_path_ = value; }
       void setIconCachePath(const char *value){ icon_cache_path_ = value; }
 
+      const std::string& getIconThemeCachePath() const { return icon_theme_cache_path_; }
+      void setIconThemeCachePath(const std::string & value){ icon_theme_cache_path_ = value; }
+      void setIconThemeCachePath(const char *value){ icon_theme_cache_path_ = value; }
+
       const std::string& getMigemoDictPath() const { return migemo_dict_path_; }
       void setMigemoDictPath(const std::string & value){ migemo_dict_path_ = value; }
       void setMigemoDictPath(const char *value){ migemo_dict_path_ = value; }
@@ -246,6 +269,9 @@ namespace ib {
         enable_icons_(true),
         icon_theme_("Hicolor"),
         max_cached_icons_(999999),
+        icon_cache_bytes_(64 * 1024 * 1024),
+        icon_cache_compression_(false),
+        icon_loader_threads_(2),
         key_event_threshold_(50),
         max_histories_(500),
         max_candidates_(15),
@@ -266,6 +292,9 @@ namespace ib {
         list_prev_key_(),
         toggle_mode_key_(),
         kill_word_key_(),
+        key_bindings_(),
+        enable_key_up_handler_(true),
+        enable_key_down_handler_(true),
 
         style_window_boxtype_(FL_BORDER_BOX),
         style_window_posx_(0),
@@ -311,6 +340,7 @@ namespace ib {
         command_cache_path_(),
         history_path_(),
         icon_cache_path_(),
+        icon_theme_cache_path_(),
         migemo_dict_path_(),
         old_pid_(-1),
         platform_(),
@@ -322,6 +352,9 @@ namespace ib {
       bool         enable_icons_;
       std::string  icon_theme_;
       unsigned int max_cached_icons_;
+      unsigned int icon_cache_bytes_;
+      bool         icon_cache_compression_;
+      unsigned int icon_loader_threads_;
       unsigned int key_event_threshold_;
       unsigned int max_histories_;
       unsigned int max_candidates_;
@@ -342,6 +375,9 @@ namespace ib {
       int list_prev_key_[3];
       int toggle_mode_key_[3];
       int kill_word_key_[3];
+      ib::KeyBindings key_bindings_;
+      bool enable_key_up_handler_;
+      bool enable_key_down_handler_;
 
       Fl_Boxtype style_window_boxtype_;
       unsigned int style_window_posx_;
@@ -388,6 +424,7 @@ namespace ib {
       std::string command_cache_path_;
       std::string history_path_;
       std::string icon_cache_path_;
+      std::string icon_theme_cache_path_;
       std::string migemo_dict_path_;
       int old_pid_;
       std::string platform_;
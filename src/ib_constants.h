@@ -31,6 +31,8 @@
 #include <memory>
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <cstdio>
 #include <sstream>
 #include <fstream>
 #include <locale>
@@ -44,7 +46,10 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <deque>
+#include <list>
 #include <limits>
+#include <chrono>
+#include <atomic>
 
 #define FL_INTERNALS
 #include <FL/Fl.H>
@@ -68,6 +73,7 @@
 #include <FL/Enumerations.H>
 #include <FL/filename.H>
 
+#include <zlib.h>
 #include <lua.hpp>
 #include <oniguruma.h>
 #include <migemo.h>
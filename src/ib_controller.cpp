@@ -136,6 +136,34 @@ void ib::Controller::executeCommand() { // {{{
   return;
 } // }}}
 
+void ib::Controller::executeShortcut(const std::string &name) { // {{{
+  const auto listbox = ib::Singleton<ib::ListWindow>::getInstance()->getListbox();
+  const auto input = ib::Singleton<ib::MainWindow>::getInstance()->getInput();
+  if(listbox->isAutocompleted()){
+    completionInput();
+    input->scan();
+  }
+
+  std::string message;
+  auto it = commands_.find(name);
+  if(it != commands_.end()){
+    std::string value(input->value());
+    std::vector<std::string*> args;
+    args.push_back(&value);
+    ib::Error error;
+    if((*it).second->execute(args, nullptr, error) != 0) {
+      message = "Failed to execute the command:";
+      message += name;
+      message += "\n";
+      message += error.getMessage();
+    }
+  }else{
+    message = "Command not found:";
+    message += name;
+  }
+  afterExecuteCommand(message.empty(), message.empty() ? nullptr : message.c_str());
+} // }}}
+
 void ib::Controller::afterExecuteCommand(const bool success, const char *message) { // {{{
   const auto main_window = ib::Singleton<ib::MainWindow>::getInstance();
   const auto input = main_window->getInput();
@@ -233,7 +261,7 @@ void ib::Controller::loadConfig(const int argc, char* const *argv) { // {{{
   cfg->setCommandCachePath(cmd_cache_path.get());
 
   ib::platform::dirname(osbuf, osconfig_path.get());
-  auto oshistory_name = ib::platform::utf82oschar("history.txt");
+  auto oshistory_name = ib::platform::utf82oschar("history.log");
   std::unique_ptr<ib::oschar[]> oshistory_path(ib::platform::join_path(nullptr, osbuf, oshistory_name.get()));
   auto history_path = ib::platform::oschar2utf8(oshistory_path.get());
   cfg->setHistoryPath(history_path.get());
@@ -244,6 +272,12 @@ void ib::Controller::loadConfig(const int argc, char* const *argv) { // {{{
   auto icon_cache_path = ib::platform::oschar2utf8(osicon_cache_path.get());
   cfg->setIconCachePath(icon_cache_path.get());
 
+  ib::platform::dirname(osbuf, osconfig_path.get());
+  auto osicon_theme_cache_name = ib::platform::utf82oschar("icon_themes.cache");
+  std::unique_ptr<ib::oschar[]> osicon_theme_cache_path(ib::platform::join_path(nullptr, osbuf, osicon_theme_cache_name.get()));
+  auto icon_theme_cache_path = ib::platform::oschar2utf8(osicon_theme_cache_path.get());
+  cfg->setIconThemeCachePath(icon_theme_cache_path.get());
+
   ib::platform::dirname(osbuf, osconfig_path.get());
   auto osmigemo_dict_name = ib::platform::utf82oschar("dict");
   std::unique_ptr<ib::oschar[]> osmigemo_dict_path(ib::platform::normalize_join_path(nullptr, osbuf, osmigemo_dict_name.get()));
@@ -299,6 +333,20 @@ void ib::Controller::loadConfig(const int argc, char* const *argv) { // {{{
        cfg->setMaxCachedIcons(number);
     }
     lua_pop(IB_LUA, 1);
+    GET_FIELD("icon_cache_bytes", number) {
+       READ_UNSIGNED_INT_M("icon_cache_bytes", 1000000000);
+       cfg->setIconCacheBytes(number);
+    }
+    lua_pop(IB_LUA, 1);
+    GET_FIELD("icon_cache_compression", boolean) {
+       cfg->setIconCacheCompression(lua_toboolean(IB_LUA, -1) != 0);
+    }
+    lua_pop(IB_LUA, 1);
+    GET_FIELD("icon_loader_threads", number) {
+       READ_UNSIGNED_INT_M("icon_loader_threads", 16);
+       cfg->setIconLoaderThreads(std::max(number, 1));
+    }
+    lua_pop(IB_LUA, 1);
     GET_FIELD("key_event_threshold", number) {
        READ_UNSIGNED_INT("key_event_threshold");
        cfg->setKeyEventThreshold(std::max(number, IB_KEY_EVENT_THRESOLD_MIN));
@@ -736,6 +784,12 @@ void ib::Controller::loadConfig(const int argc, char* const *argv) { // {{{
       }
       lua_pop(IB_LUA, 1);
 
+      GET_FIELD("completion_ttl", number) {
+        READ_UNSIGNED_INT_M("completion_ttl", 86400);
+        ib::Singleton<ib::Completer>::getInstance()->setOptionCacheTtl(command->getName(), number * 1000);
+      }
+      lua_pop(IB_LUA, 1);
+
       if(command->getName() == "" || command->getPath() == ""){
         fl_alert("Command must have 'name' and 'path' attibutes.");
         ib::utils::exit_application(1);
@@ -769,6 +823,49 @@ void ib::Controller::loadConfig(const int argc, char* const *argv) { // {{{
   assert(lua_gettop(IB_LUA) == 0);
   // }}}
 
+  // Key bindings {{{
+  auto &key_bindings = cfg->getKeyBindings();
+  key_bindings.clear();
+  key_bindings.bind(cfg->getEscapeKey(), ib::KeyBindings::ESCAPE);
+  key_bindings.bind(cfg->getListNextKey(), ib::KeyBindings::LIST_NEXT);
+  key_bindings.bind(cfg->getListPrevKey(), ib::KeyBindings::LIST_PREV);
+  key_bindings.bind(cfg->getToggleModeKey(), ib::KeyBindings::TOGGLE_MODE);
+  key_bindings.bind(cfg->getKillWordKey(), ib::KeyBindings::KILL_WORD);
+
+  lua_getglobal(IB_LUA, "shortcuts");
+  if(lua_istable(IB_LUA, -1)) {
+    for(i = 1;;i++){
+      GET_LIST(i, table) {
+        memset(key_buf, 0, sizeof(key_buf));
+        GET_FIELD("key", string) {
+          PARSE_KEY_BIND("shortcuts.key");
+        }
+        lua_pop(IB_LUA, 1);
+        GET_FIELD("name", string) {
+          if(key_buf[0] != 0) {
+            key_bindings.bind(key_buf, ib::KeyBindings::SHORTCUT, lua_tostring(IB_LUA, -1));
+          }
+        }
+        lua_pop(IB_LUA, 1);
+      }
+      lua_pop(IB_LUA, 1);
+    }
+  }
+  lua_pop(IB_LUA, 1);
+
+  // the hot key has the highest priority
+  key_bindings.bind(cfg->getHotKey(), ib::KeyBindings::HOT_KEY);
+
+  // event handlers that are not defined are never called
+  lua_getglobal(IB_LUA, "on_key_up");
+  cfg->setEnableKeyUpHandler(lua_isfunction(IB_LUA, -1) != 0);
+  lua_pop(IB_LUA, 1);
+  lua_getglobal(IB_LUA, "on_key_down");
+  cfg->setEnableKeyDownHandler(lua_isfunction(IB_LUA, -1) != 0);
+  lua_pop(IB_LUA, 1);
+  assert(lua_gettop(IB_LUA) == 0);
+  // }}}
+
 #undef PARSE_KEY_BIND_CONST
 #undef PARSE_KEY_BIND
 #undef ENUMERATE_TABLE
@@ -862,6 +959,19 @@ void ib::Controller::cacheCommandsInSearchPath(const char *category) {
     }
   }
 
+  // icons of the new commands are loaded before the application reboots,
+  // so that they are written to the icon cache file. Loading stops when
+  // the icon cache is full.
+  if(cfg->getEnableIcons()) {
+    std::vector<ib::IconRequest> requests;
+    for(long i = prev_index, l = commands.size(); i < l; ++i){
+      const auto command = commands.at(i);
+      requests.push_back(ib::IconRequest(command->hasDescription() ? IB_ICON_SIZE_LARGE : IB_ICON_SIZE_SMALL));
+      command->getIconRequest(requests.back());
+    }
+    ib::Singleton<ib::IconManager>::getInstance()->preloadIcons(requests, cfg->getIconLoaderThreads());
+  }
+
   auto locache_path = ib::platform::utf82local(cfg->getCommandCachePath().c_str());
   std::ofstream ofs(locache_path.get());
   for(const auto &c : commands) {
@@ -943,7 +1053,7 @@ void ib::Controller::completionInput() { // {{{
     int i = 0;
     for(auto it = input->getTokens().begin(), last = input->getTokens().end(); it != last; ++it, ++i){
       if(i == input->getCursorTokenIndex()){
-        const auto &cursor_value = input->getCursorToken()->getValue();
+        const auto cursor_value = input->getCursorToken()->getValue().str();
         if(!input->getCursorToken()->isValueToken()) {
           buf += cursor_value;
         }
@@ -995,7 +1105,8 @@ void ib::Controller::showCompletionCandidates() {
   const auto completer = ib::Singleton<ib::Completer>::getInstance();
 
   input->scan();
-  if(input->getPrevCursorValue().size() != 0 && input->getCursorToken()->getValue().find(input->getPrevCursorValue()) != 0) {
+  completer->cancelOptionCompletion();
+  if(input->getPrevCursorValue().size() != 0 && !input->getCursorToken()->getValue().startsWith(input->getPrevCursorValue())) {
     listbox->clearAll();
   }
 
@@ -1004,8 +1115,8 @@ void ib::Controller::showCompletionCandidates() {
     return;
   }
   listbox->startUpdate();
-  const auto &first_value = input->getFirstValue();
-  const auto &cursor_value = input->getCursorValue();
+  const auto first_value = input->getFirstValue();
+  const auto cursor_value = input->getCursorValue();
   auto os_cursor_value = ib::platform::utf82oschar(cursor_value.c_str());
   std::vector<ib::CompletionValue*> candidates;
 
@@ -1037,7 +1148,7 @@ void ib::Controller::showCompletionCandidates() {
       if(input->isUsingCwd()) {
         ib::platform::utf82oschar_b(oscwd, IB_MAX_PATH, getCwd().c_str());
       }else{
-        const auto &cmdname = input->getFirstValue();
+        const auto &cmdname = first_value;
         auto it = commands_.find(cmdname);
         if(it != commands_.end()){
           ib::platform::utf82oschar_b(oscwd, IB_MAX_PATH, (*it).second->getWorkdir().c_str());
@@ -1061,6 +1172,12 @@ void ib::Controller::showCompletionCandidates() {
     std::stable_sort(candidates.begin(), candidates.end(), cmp_command);
   }
 
+  updateCompletionCandidates(candidates, use_max_candidates);
+} // }}}
+
+void ib::Controller::updateCompletionCandidates(const std::vector<ib::CompletionValue*> &candidates, const bool use_max_candidates) { // {{{
+  const auto listbox = ib::Singleton<ib::ListWindow>::getInstance()->getListbox();
+  const auto input   = ib::Singleton<ib::MainWindow>::getInstance()->getInput();
   listbox->clearAll();
 
   for(const auto &c : candidates) {
@@ -1150,7 +1267,7 @@ void ib::Controller::killWord() { // {{{
   int i = 0;
   for(auto it = tokens.begin(), last = tokens.end(); it != last; ++it, ++i){
     if(i == input->getCursorTokenIndex()){
-      const auto &cursor_value = (*it)->getValue();
+      const auto cursor_value = (*it)->getValue().str();
       auto os_value = ib::platform::utf82oschar(cursor_value.c_str());
       if(ib::platform::is_path(os_value.get())){
         ib::oschar os_dirname[IB_MAX_PATH];
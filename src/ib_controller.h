@@ -21,11 +21,13 @@ namespace ib {
       void loadCachedCommands();
       void addCommand(const std::string &name, ib::BaseCommand *command);
       void executeCommand();
+      void executeShortcut(const std::string &name);
       void afterExecuteCommand(const bool success, const char *message);
       void hideApplication();
       void showApplication();
       void completionInput();
       void showCompletionCandidates();
+      void updateCompletionCandidates(const std::vector<ib::CompletionValue*> &candidates, const bool use_max_candidates);
       void selectNextCompletion();
       void selectPrevCompletion();
       void handleIpcMessage(const char* message);
@@ -1,146 +1,690 @@
 #include "ib_history.h"
 #include "ib_config.h"
 #include "ib_comp_value.h"
+#include "ib_completer.h"
 #include "ib_platform.h"
 #include "ib_regex.h"
 #include "ib_singleton.h"
 
+// class HistoryLog {{{
+const char ib::HistoryLog::MAGIC[] = "IBHL";
+
+static ib::u32 fnv1a(const char *data, const std::size_t size, ib::u32 hash = 2166136261u) { // {{{
+  for(std::size_t i = 0; i < size; ++i) {
+    hash ^= (unsigned char)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+} // }}}
+
+ib::threadret ib::_history_log_thread(void *p) { // {{{
+  reinterpret_cast<ib::HistoryLog*>(p)->run();
+  ib::platform::exit_thread(0);
+  return (ib::threadret)0;
+} // }}}
+
+int ib::HistoryLog::open(const std::string &path, const std::size_t record_count, ib::Error &error) { // {{{
+  auto lopath = ib::platform::utf82local(path.c_str());
+  auto fp = std::fopen(lopath.get(), "ab");
+  if(fp == nullptr) {
+    error.setCode(1);
+    error.setMessage("Failed to open the history log.");
+    return 1;
+  }
+  std::fseek(fp, 0, SEEK_END);
+  if(std::ftell(fp) == 0) {
+    std::string header;
+    writeHeader(header);
+    std::fwrite(header.data(), 1, header.size(), fp);
+    std::fflush(fp);
+  }
+  path_ = path;
+  fp_ = fp;
+  record_count_ = record_count;
+  ib::platform::create_cmutex(&cmutex_);
+  ib::platform::create_condition(&cond_);
+  running_ = 1;
+  ib::platform::create_thread(&thread_, &ib::_history_log_thread, this);
+  return 0;
+} // }}}
+
+void ib::HistoryLog::close() { // {{{
+  if(path_.empty()) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  running_ = 0;
+  ib::platform::notify_condition(&cond_);
+  ib::platform::unlock_cmutex(&cmutex_);
+  ib::platform::join_thread(&thread_);
+  ib::platform::destroy_cmutex(&cmutex_);
+  ib::platform::destroy_condition(&cond_);
+
+  if(fp_ != nullptr) {
+    ib::Error error;
+    ib::platform::sync_file(fp_, error); // ignore errors
+    std::fclose(fp_);
+    fp_ = nullptr;
+  }
+  path_.clear();
+} // }}}
+
+void ib::HistoryLog::append(const std::string &record) { // {{{
+  if(path_.empty()) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  if(fp_ != nullptr) {
+    std::fwrite(record.data(), 1, record.size(), fp_);
+    std::fflush(fp_);
+  } else {
+    // the log could not be reopened after the compaction.
+    unwritten_ += record;
+  }
+  record_count_++;
+  unsynced_count_++;
+  if(is_compacting_) {
+    pending_ += record;
+    pending_count_++;
+  }
+  ib::platform::unlock_cmutex(&cmutex_);
+} // }}}
+
+void ib::HistoryLog::compact(std::string &records, const std::size_t count) { // {{{
+  if(path_.empty()) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  if(!is_compacting_) {
+    compaction_.swap(records);
+    compaction_count_ = count;
+    is_compacting_ = true;
+    ib::platform::notify_condition(&cond_);
+  }
+  ib::platform::unlock_cmutex(&cmutex_);
+} // }}}
+
+std::size_t ib::HistoryLog::getRecordCount() { // {{{
+  if(path_.empty()) return 0;
+  ib::platform::lock_cmutex(&cmutex_);
+  auto ret = record_count_;
+  ib::platform::unlock_cmutex(&cmutex_);
+  return ret;
+} // }}}
+
+bool ib::HistoryLog::needsCompaction(const std::size_t threshold) { // {{{
+  if(path_.empty()) return false;
+  ib::platform::lock_cmutex(&cmutex_);
+  auto ret = !is_compacting_ && record_count_ > std::max(threshold, retry_count_);
+  ib::platform::unlock_cmutex(&cmutex_);
+  return ret;
+} // }}}
+
+bool ib::HistoryLog::getError(ib::Error &error) { // {{{
+  if(path_.empty()) return false;
+  ib::platform::lock_cmutex(&cmutex_);
+  auto ret = !error_.empty();
+  if(ret) {
+    error.setCode(1);
+    error.setMessage(error_);
+    error_.clear();
+  }
+  ib::platform::unlock_cmutex(&cmutex_);
+  return ret;
+} // }}}
+
+bool ib::HistoryLog::isCompacting() { // {{{
+  if(path_.empty()) return false;
+  ib::platform::lock_cmutex(&cmutex_);
+  auto ret = is_compacting_;
+  ib::platform::unlock_cmutex(&cmutex_);
+  return ret;
+} // }}}
+
+void ib::HistoryLog::run() { // {{{
+  ib::platform::on_thread_start();
+  ib::Error error;
+  ib::platform::lock_cmutex(&cmutex_);
+  while(1) {
+    if(fp_ == nullptr) {
+      reopen();
+    }
+    if(is_compacting_ && !compaction_.empty()) {
+      doCompaction();
+    }
+    if(unsynced_count_ != 0 && fp_ != nullptr) {
+      // fflush and fsync do not need the lock, appended records are
+      // written to the same file.
+      unsynced_count_ = 0;
+      auto fp = fp_;
+      ib::platform::unlock_cmutex(&cmutex_);
+      ib::platform::sync_file(fp, error); // ignore errors
+      ib::platform::lock_cmutex(&cmutex_);
+    }
+    if(!running_) break;
+    ib::platform::wait_condition(&cond_, &cmutex_, SYNC_INTERVAL);
+  }
+  ib::platform::unlock_cmutex(&cmutex_);
+} // }}}
+
+int ib::HistoryLog::doCompaction() { // {{{
+  // called with the lock held.
+  std::string records;
+  records.swap(compaction_);
+  auto count = compaction_count_;
+  ib::platform::unlock_cmutex(&cmutex_);
+
+  // the bulk of the records is synced without the lock, so that append
+  // does not wait for it.
+  ib::Error error;
+  auto tmp_path = path_ + ".tmp";
+  auto lotmp_path = ib::platform::utf82local(tmp_path.c_str());
+  auto ostmp_path = ib::platform::utf82oschar(tmp_path.c_str());
+  auto ospath = ib::platform::utf82oschar(path_.c_str());
+  auto fp = std::fopen(lotmp_path.get(), "wb");
+  auto ok = fp != nullptr && std::fwrite(records.data(), 1, records.size(), fp) == records.size();
+  if(ok) {
+    ok = ib::platform::sync_file(fp, error) == 0;
+  }
+
+  ib::platform::lock_cmutex(&cmutex_);
+  if(ok && !pending_.empty()) {
+    ok = std::fwrite(pending_.data(), 1, pending_.size(), fp) == pending_.size() &&
+         ib::platform::sync_file(fp, error) == 0;
+  }
+  if(fp != nullptr) std::fclose(fp);
+  if(ok) {
+    // the log must be closed before it is replaced on Windows.
+    if(fp_ != nullptr) std::fclose(fp_);
+    fp_ = nullptr;
+    ok = ib::platform::rename_file(ostmp_path.get(), ospath.get(), error) == 0;
+    if(ok) {
+      record_count_ = count + pending_count_;
+    }
+    reopen();
+  }
+  if(ok) {
+    retry_count_ = 0;
+  } else {
+    // retries when the log gets twice as large, instead of rewriting
+    // it on every append.
+    retry_count_ = record_count_ * 2;
+    error_ = "Failed to compact the history log.";
+    if(!error.getMessage().empty()) {
+      error_ += " " + error.getMessage();
+    }
+    ib::Error remove_error;
+    ib::platform::remove_file(ostmp_path.get(), remove_error); // ignore errors
+  }
+  pending_.clear();
+  pending_count_ = 0;
+  is_compacting_ = false;
+  return ok ? 0 : 1;
+} // }}}
+
+void ib::HistoryLog::reopen() { // {{{
+  // called with the lock held.
+  fp_ = std::fopen(ib::platform::utf82local(path_.c_str()).get(), "ab");
+  if(fp_ == nullptr) {
+    if(!is_reopen_failed_) {
+      is_reopen_failed_ = true;
+      error_ = "Failed to reopen the history log. Histories are kept in memory until it can be reopened.";
+    }
+    return;
+  }
+  is_reopen_failed_ = false;
+  if(!unwritten_.empty()) {
+    std::fwrite(unwritten_.data(), 1, unwritten_.size(), fp_);
+    std::fflush(fp_);
+    unwritten_.clear();
+    unsynced_count_++;
+  }
+} // }}}
+
+void ib::HistoryLog::writeHeader(std::string &buf) { // {{{
+  char bytes[4];
+  buf.append(MAGIC, 4);
+  ib::utils::u32int2bebytes(bytes, VERSION);
+  buf.append(bytes, 4);
+} // }}}
+
+bool ib::HistoryLog::readHeader(const char *data, const std::size_t size) { // {{{
+  return size >= HEADER_SIZE && memcmp(data, MAGIC, 4) == 0 &&
+         ib::utils::bebytes2u32int(data+4) == VERSION;
+} // }}}
+
+void ib::HistoryLog::writeRecord(std::string &buf, const std::string &name, const std::string &path, const std::time_t time) { // {{{
+  char header[RECORD_HEADER_SIZE];
+  const auto t = static_cast<long long>(time);
+  ib::utils::u32int2bebytes(header+4,  (ib::u32)name.size());
+  ib::utils::u32int2bebytes(header+8,  (ib::u32)path.size());
+  ib::utils::u32int2bebytes(header+12, (ib::u32)(((unsigned long long)t >> 32) & 0xffffffff));
+  ib::utils::u32int2bebytes(header+16, (ib::u32)((unsigned long long)t & 0xffffffff));
+  auto checksum = fnv1a(header+4, RECORD_HEADER_SIZE-4);
+  checksum = fnv1a(name.data(), name.size(), checksum);
+  checksum = fnv1a(path.data(), path.size(), checksum);
+  ib::utils::u32int2bebytes(header, checksum);
+
+  buf.append(header, RECORD_HEADER_SIZE);
+  buf += name;
+  buf += path;
+} // }}}
+
+const char* ib::HistoryLog::readRecord(const char *data, const char *end, ib::StringView &name, ib::StringView &path, std::time_t &time) { // {{{
+  if((std::size_t)(end - data) < RECORD_HEADER_SIZE) return nullptr;
+  const auto name_size = (std::size_t)ib::utils::bebytes2u32int(data+4);
+  const auto path_size = (std::size_t)ib::utils::bebytes2u32int(data+8);
+  const auto rest = (std::size_t)(end - data) - RECORD_HEADER_SIZE;
+  if(name_size > rest || path_size > rest - name_size) return nullptr;
+
+  const auto body = data + RECORD_HEADER_SIZE;
+  auto checksum = fnv1a(data+4, RECORD_HEADER_SIZE-4);
+  checksum = fnv1a(body, name_size + path_size, checksum);
+  if(checksum != ib::utils::bebytes2u32int(data)) return nullptr;
+
+  const auto t = ((unsigned long long)ib::utils::bebytes2u32int(data+12) << 32) |
+                  (unsigned long long)ib::utils::bebytes2u32int(data+16);
+  time = (std::time_t)(long long)t;
+  name = ib::StringView(body, name_size);
+  path = ib::StringView(body + name_size, path_size);
+  return body + name_size + path_size;
+} // }}}
+
+// }}}
+
+// class HistoryIndex {{{
+ib::HistoryIndex::Node* ib::HistoryIndex::Node::findChild(const char c) const { // {{{
+  for(auto &child : children) {
+    if(child->label[0] == c) return child;
+  }
+  return nullptr;
+} // }}}
+
+std::string ib::HistoryIndex::toKey(const std::string &value) { // {{{
+  // same as strcasestr, only ASCII characters are case-insensitive.
+  std::string key(value);
+  for(auto &c : key) {
+    if(c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+  }
+  return key;
+} // }}}
+
+ib::u32 ib::HistoryIndex::toTrigram(const char *value) { // {{{
+  return ((ib::u32)(unsigned char)value[0] << 16) | ((ib::u32)(unsigned char)value[1] << 8) | (ib::u32)(unsigned char)value[2];
+} // }}}
+
+void ib::HistoryIndex::add(ib::HistoryCommand *command) { // {{{
+  const auto key = toKey(command->getPath());
+  auto node = root_;
+  std::size_t pos = 0;
+  while(pos < key.size()) {
+    auto child = node->findChild(key[pos]);
+    if(child == nullptr) {
+      child = new Node();
+      child->label = key.substr(pos);
+      node->children.push_back(child);
+      node = child;
+      break;
+    }
+    std::size_t common = 0;
+    const auto max_common = std::min(child->label.size(), key.size() - pos);
+    while(common < max_common && child->label[common] == key[pos+common]) common++;
+    if(common < child->label.size()) {
+      // splits the edge
+      auto mid = new Node();
+      mid->label = child->label.substr(0, common);
+      child->label.erase(0, common);
+      mid->children.push_back(child);
+      *std::find(node->children.begin(), node->children.end(), child) = mid;
+      child = mid;
+    }
+    node = child;
+    pos += common;
+  }
+  node->commands.push_back(command);
+
+  for(std::size_t i = 0; i + 3 <= key.size(); ++i) {
+    trigrams_[toTrigram(key.c_str() + i)].insert(command);
+  }
+} // }}}
+
+void ib::HistoryIndex::remove(ib::HistoryCommand *command) { // {{{
+  const auto key = toKey(command->getPath());
+  std::vector<Node*> nodes;
+  auto node = root_;
+  std::size_t pos = 0;
+  nodes.push_back(node);
+  while(pos < key.size()) {
+    node = node->findChild(key[pos]);
+    if(node == nullptr || key.compare(pos, node->label.size(), node->label) != 0) return;
+    pos += node->label.size();
+    nodes.push_back(node);
+  }
+  auto &commands = node->commands;
+  auto it = std::find(commands.begin(), commands.end(), command);
+  if(it == commands.end()) return;
+  commands.erase(it);
+
+  // removes empty nodes and merges nodes that have only one child.
+  for(std::size_t i = nodes.size() - 1; i > 0; --i) {
+    auto n = nodes.at(i);
+    auto parent = nodes.at(i-1);
+    if(!n->commands.empty()) break;
+    if(n->children.empty()) {
+      parent->children.erase(std::find(parent->children.begin(), parent->children.end(), n));
+      delete n;
+      continue;
+    }
+    if(n->children.size() == 1) {
+      auto child = n->children.at(0);
+      child->label = n->label + child->label;
+      n->children.clear();
+      *std::find(parent->children.begin(), parent->children.end(), n) = child;
+      delete n;
+    }
+    break;
+  }
+
+  for(std::size_t i = 0; i + 3 <= key.size(); ++i) {
+    auto t = trigrams_.find(toTrigram(key.c_str() + i));
+    if(t == trigrams_.end()) continue;
+    (*t).second.erase(command);
+    if((*t).second.empty()) trigrams_.erase(t);
+  }
+} // }}}
+
+void ib::HistoryIndex::findPrefix(std::vector<ib::HistoryCommand*> &result, const std::string &prefix) const { // {{{
+  const auto key = toKey(prefix);
+  auto node = root_;
+  std::size_t pos = 0;
+  while(pos < key.size()) {
+    node = node->findChild(key[pos]);
+    if(node == nullptr) return;
+    const auto size = std::min(node->label.size(), key.size() - pos);
+    if(key.compare(pos, size, node->label, 0, size) != 0) return;
+    pos += size;
+  }
+
+  std::vector<const Node*> stack;
+  stack.push_back(node);
+  while(!stack.empty()) {
+    auto n = stack.back();
+    stack.pop_back();
+    result.insert(result.end(), n->commands.begin(), n->commands.end());
+    stack.insert(stack.end(), n->children.begin(), n->children.end());
+  }
+} // }}}
+
+bool ib::HistoryIndex::findSubstring(std::vector<ib::HistoryCommand*> &result, const std::string &value) const { // {{{
+  if(value.size() < 3) return false;
+  const auto key = toKey(value);
+  const std::unordered_set<ib::HistoryCommand*> *smallest = nullptr;
+  for(std::size_t i = 0; i + 3 <= key.size(); ++i) {
+    auto t = trigrams_.find(toTrigram(key.c_str() + i));
+    if(t == trigrams_.end()) return true;
+    if(smallest == nullptr || (*t).second.size() < smallest->size()) smallest = &((*t).second);
+  }
+  result.insert(result.end(), smallest->begin(), smallest->end());
+  return true;
+} // }}}
+
+// }}}
+
 void ib::History::load() { // {{{
   const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
   auto oshistory_path = ib::platform::utf82oschar(cfg->getHistoryPath().c_str());
-  if(!ib::platform::file_exists(oshistory_path.get())) return;
+  ib::Error error;
+  std::size_t record_count = 0;
+  bool needs_compaction = false;
+
+  if(ib::platform::file_exists(oshistory_path.get())) {
+    ib::platform::MappedFile file;
+    if(file.open(oshistory_path.get(), error) == 0) {
+      auto valid_size = replayLog(file.getData(), file.getSize(), record_count);
+      // a crash may leave a partially written record.
+      needs_compaction = valid_size != file.getSize() || record_count > cfg->getMaxHistories();
+    }
+  } else {
+    ib::oschar osdir[IB_MAX_PATH];
+    ib::platform::dirname(osdir, oshistory_path.get());
+    auto ostext_name = ib::platform::utf82oschar("history.txt");
+    std::unique_ptr<ib::oschar[]> ostext_path(ib::platform::join_path(nullptr, osdir, ostext_name.get()));
+    needs_compaction = importTextHistory(ostext_path.get()) != 0;
+  }
 
-  auto lohistory_path = ib::platform::utf82local(cfg->getHistoryPath().c_str());
-  std::ifstream ifs(lohistory_path.get());
-  std::string buf;
-  ib::Regex re("\t", ib::Regex::NONE);
-  re.init();
+  if(log_.open(cfg->getHistoryPath(), record_count, error) != 0) return;
+  if(needs_compaction) compactLog();
+} // }}}
+
+std::size_t ib::History::replayLog(const char *data, const std::size_t size, std::size_t &record_count) { // {{{
+  const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
+  record_count = 0;
+  if(!ib::HistoryLog::readHeader(data, size)) return 0;
 
-  while(ifs && getline(ifs, buf)) {
-    auto fields = re.split(buf);
+  const auto end = data + size;
+  ib::StringView name, path;
+  std::time_t time;
+  const char *ptr = data + ib::HistoryLog::HEADER_SIZE;
+  const char *next;
+  for(; (next = ib::HistoryLog::readRecord(ptr, end, name, path, time)) != nullptr; ptr = next) {
+    record_count++;
+  }
+  const auto valid_size = (std::size_t)(ptr - data);
+
+  // only the last max_histories records are loaded.
+  std::size_t skip = record_count > cfg->getMaxHistories() ? record_count - cfg->getMaxHistories() : 0;
+  ptr = data + ib::HistoryLog::HEADER_SIZE;
+  for(std::size_t i = 0; i < record_count; ++i, ptr = next) {
+    next = ib::HistoryLog::readRecord(ptr, end, name, path, time);
+    if(i < skip) continue;
     auto cmd = new HistoryCommand();
-    cmd->setName(fields.at(0));
-    cmd->setPath(fields.at(1));
-    cmd->addTime((std::time_t)atoi(fields.at(2).c_str()));
+    cmd->setName(name.str());
+    cmd->setPath(path.str());
+    cmd->addTime(time);
     addCommand(cmd);
   }
+  return valid_size;
+} // }}}
+
+std::size_t ib::History::importTextHistory(const ib::oschar *path) { // {{{
+  // iceberg 0.9.13 and earlier saved histories as 'name\tpath\ttime' lines.
+  ib::Error error;
+  ib::platform::MappedFile file;
+  if(!ib::platform::file_exists(path) || file.open(path, error) != 0) return 0;
 
-  ifs.close();
+  std::size_t count = 0;
+  const char *ptr = file.getData();
+  const auto end = ptr + file.getSize();
+  while(ptr < end) {
+    auto eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+    if(eol == nullptr) eol = end;
+    auto tab1 = static_cast<const char*>(memchr(ptr, '\t', eol - ptr));
+    auto tab2 = tab1 == nullptr ? nullptr : static_cast<const char*>(memchr(tab1+1, '\t', eol - tab1 - 1));
+    if(tab2 != nullptr) {
+      auto cmd = new HistoryCommand();
+      cmd->setName(std::string(ptr, tab1));
+      cmd->setPath(std::string(tab1+1, tab2));
+      cmd->addTime((std::time_t)atoll(std::string(tab2+1, eol).c_str()));
+      addCommand(cmd);
+      count++;
+    }
+    ptr = eol + 1;
+  }
+  return count;
 } // }}}
 
 void ib::History::dump() { // {{{
+  log_.close();
+} // }}}
+
+void ib::History::appendLog(const std::string &name, const std::string &path, const std::time_t time) { // {{{
   const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
+  std::string record;
+  ib::HistoryLog::writeRecord(record, name, path, time);
+  log_.append(record);
   ib::Error error;
-
-  ib::oschar osbkfile[IB_MAX_PATH];
-  ib::oschar osfile[IB_MAX_PATH];
-  ib::platform::utf82oschar_b(osbkfile, IB_MAX_PATH, (cfg->getHistoryPath()+".bk").c_str());
-  ib::platform::utf82oschar_b(osfile, IB_MAX_PATH, cfg->getHistoryPath().c_str());
-  ib::platform::remove_file(osbkfile, error); // ignore errors
-  ib::platform::copy_file(osfile, osbkfile, error); // ignore errors
-
-  auto lohistory_path = ib::platform::utf82local(cfg->getHistoryPath().c_str());
-  std::ofstream ofs(lohistory_path.get());
-  auto it = ordered_commands_.begin();
-  if(ordered_commands_.size() > cfg->getMaxHistories()){
-    std::advance(it, ordered_commands_.size() - cfg->getMaxHistories());
+  if(log_.getError(error)) {
+    ib::utils::message_box("%s", error.getMessage().c_str());
   }
 
-  for(auto last = ordered_commands_.end(); it != last; ++it){
-    auto cmd = *it;
-    ofs << cmd->getName() << "\t" << cmd->getPath() << "\t" << cmd->getTimes().at(0) << std::endl;
+  // the log is compacted when it gets twice as large as max_histories.
+  if(log_.needsCompaction(std::max<std::size_t>(cfg->getMaxHistories(), 1) * 2)) {
+    compactLog();
   }
-  ofs.close();
+} // }}}
 
-  size_t file_size = 0;
-  ib::platform::file_size(file_size, osfile, error);
-  if(file_size == 0){
-    ib::platform::copy_file(osbkfile, osfile, error); // ignore errors
+void ib::History::compactLog() { // {{{
+  std::string records;
+  ib::HistoryLog::writeHeader(records);
+  const auto size = executions_.size();
+  for(std::size_t i = 0; i < size; ++i){
+    const auto &execution = executions_.at((executions_head_ + i) % size);
+    ib::HistoryLog::writeRecord(records, execution.first->getName(), execution.first->getPath(), execution.second);
   }
-  ib::platform::remove_file(osbkfile, error); // ignore errors
+  log_.compact(records, size);
 } // }}}
 
 void ib::History::addCommand(ib::HistoryCommand *command) { // {{{
-  command->init();
+  const auto time = command->getTimes().at(0);
   auto cmd = command;
-  if(commands_.find(command->getPath()) == commands_.end()){
-    commands_[command->getPath()] = command;
+  auto it = commands_.find(command->getPath());
+  const auto is_new = it == commands_.end();
+  if(is_new){
+    command->init();
+    recent_commands_.push_front(command);
+    commands_[command->getPath()] = recent_commands_.begin();
+    index_.add(command);
   }else{
-    commands_[command->getPath()]->addTime(command->getTimes().at(0));
-    cmd = commands_[command->getPath()];
+    cmd = *((*it).second);
+    cmd->addTime(time);
+    recent_commands_.splice(recent_commands_.begin(), recent_commands_, (*it).second);
+    delete command;
   }
-  ordered_commands_.push_back(command);
 
-  total_score_ -= cmd->getRawScore();
-  calcRawScore(cmd);
-  total_score_ += cmd->getRawScore();
+  cmd->setRecency(++recency_);
+  updateRawScore(cmd, cmd->getRawScore() + frecencyWeight(time), !is_new);
+  pushExecution(cmd, time);
 } // }}}
 
 void ib::History::addBaseCommandHistory(const std::string &value, const ib::BaseCommand* cmd){ // {{{
+   const auto now = std::time(0);
    auto hcmd = new HistoryCommand();
    hcmd->setName(cmd->getName());
    hcmd->setPath(value);
-   hcmd->addTime(std::time(0));
+   hcmd->addTime(now);
    addCommand(hcmd);
+   appendLog(cmd->getName(), value, now);
 } // }}}
 
 void ib::History::addRawInputHistory(const std::string &value) { // {{{
+   const auto now = std::time(0);
    auto hcmd = new HistoryCommand();
    hcmd->setName(value);
    hcmd->setPath(value);
-   hcmd->addTime(std::time(0));
+   hcmd->addTime(now);
    addCommand(hcmd);
+   appendLog(value, value, now);
 } // }}}
 
-void ib::History::calcRawScore(ib::HistoryCommand *command){ // {{{
-  int score = 0;
-  auto now = std::time(0);
-  const auto &times = command->getTimes();
-  for(const auto &t : times) {
-    std::time_t diff = now - t;
-    if(diff < 60*15){
-      score += 8;
-    }else if(diff < 60*60){
-      score += 6;
-    }else if(diff < 60*60*6){
-      score += 5;
-    }else if(diff < 60*60*24){
-      score += 4;
-    }else if(diff < 60*60*24*3){
-      score += 3;
-    }else if(diff < 60*60*24*7){
-      score += 2;
-    }else if(diff < 60*60*24*14){
-      score += 1;
-    }
+void ib::History::pushExecution(ib::HistoryCommand *command, const std::time_t time) { // {{{
+  const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
+  const auto capacity = std::max<std::size_t>(cfg->getMaxHistories(), 1);
+  if(executions_.size() < capacity) {
+    executions_.push_back(std::make_pair(command, time));
+    return;
   }
-  command->setRawScore(score);
+  const auto oldest = executions_.at(executions_head_);
+  executions_.at(executions_head_) = std::make_pair(command, time);
+  executions_head_ = (executions_head_ + 1) % executions_.size();
+  removeExecution(oldest.first, oldest.second);
 } // }}}
 
-double ib::History::calcScore(const std::string &name, double average, double se){ // {{{
-  if(commands_.empty()) {
-    return 0.0;
+void ib::History::removeExecution(ib::HistoryCommand *command, const std::time_t time) { // {{{
+  // executions are removed in order, so it is the oldest time of the command.
+  command->removeOldestTime();
+  if(!command->getTimes().empty()) {
+    updateRawScore(command, std::max(0.0, command->getRawScore() - frecencyWeight(time)), true);
+    return;
   }
-  auto it = commands_.find(name);
-  if(it == commands_.end()) return 0.0;
-  const auto command = (*it).second;
-  const auto v = command->getRawScore() - average;
-  if(v < 0.001) return 0.5;
+  removeScoreStat(command->getRawScore());
+  auto it = commands_.find(command->getPath());
+  recent_commands_.erase((*it).second);
+  commands_.erase(it);
+  index_.remove(command);
+  // the completion list may still show the command.
+  retired_commands_.push_back(command);
+} // }}}
+
+void ib::History::freeRetiredCommands() { // {{{
+  for(auto &c : retired_commands_) { delete c; }
+  retired_commands_.clear();
+} // }}}
+
+double ib::History::frecencyWeight(const std::time_t time) const { // {{{
+  return std::pow(2.0, static_cast<double>(time - frecency_epoch_) / FRECENCY_HALF_LIFE);
+} // }}}
+
+void ib::History::updateRawScore(ib::HistoryCommand *command, const double value, const bool is_counted){ // {{{
+  if(is_counted) removeScoreStat(command->getRawScore());
+  command->setRawScore(value);
+  addScoreStat(value);
 
-  return std::min(1.0, ((10 * (command->getRawScore() - average)) / se + 50) / 100.0);
+  if(value > 1e100) rebaseFrecency();
 } // }}}
 
-double ib::History::calcScoreSe(){ // {{{
-  if(commands_.empty()) {
-    return 0.0;
+void ib::History::addScoreStat(const double value){ // {{{
+  score_count_++;
+  const auto delta = value - score_mean_;
+  score_mean_ += delta / score_count_;
+  score_m2_ += delta * (value - score_mean_);
+} // }}}
+
+void ib::History::removeScoreStat(const double value){ // {{{
+  if(score_count_ <= 1) {
+    score_count_ = 0;
+    score_mean_ = 0.0;
+    score_m2_ = 0.0;
+    return;
   }
+  const auto mean = score_mean_ - (value - score_mean_) / (score_count_ - 1);
+  score_m2_ -= (value - score_mean_) * (value - mean);
+  score_mean_ = mean;
+  score_count_--;
+} // }}}
+
+void ib::History::rebaseFrecency(){ // {{{
+  const auto now = std::time(0);
+  const auto factor = std::pow(2.0, static_cast<double>(frecency_epoch_ - now) / FRECENCY_HALF_LIFE);
+  frecency_epoch_ = now;
+  score_count_ = 0;
+  score_mean_ = 0.0;
+  score_m2_ = 0.0;
+  for(auto &cmd : recent_commands_) {
+    cmd->setRawScore(cmd->getRawScore() * factor);
+    addScoreStat(cmd->getRawScore());
+  }
+} // }}}
+
+static bool cmp_recency(const ib::HistoryCommand *a, const ib::HistoryCommand *b) {
+  return a->getRecency() > b->getRecency();
+}
 
-  const auto avr = getAverageScore();
-  double sum = 0;
-  for(const auto &c : commands_) {
-    ib::HistoryCommand *cmd = c.second;
-    sum += std::pow(cmd->getRawScore() - avr, 2);
+bool ib::History::findCandidates(std::vector<ib::HistoryCommand*> &result, const int method, const std::string &input) const { // {{{
+  if(input.empty()) return false;
+  if(method == ib::CompletionMethod::BEGINS_WITH) {
+    index_.findPrefix(result, input);
+  }else if(method == ib::CompletionMethod::PARTIAL) {
+    if(!index_.findSubstring(result, input)) return false;
+  }else{
+    return false;
   }
-  return std::sqrt(sum / commands_.size());
+  std::sort(result.begin(), result.end(), cmp_recency);
+  return true;
 } // }}}
 
+double ib::History::calcScore(const std::string &name, double average, double se){ // {{{
+  auto it = commands_.find(name);
+  if(it == commands_.end()) return 0.0;
+  return calcScore(*((*it).second), average, se);
+} // }}}
+
+double ib::History::calcScore(const ib::HistoryCommand *command, double average, double se){ // {{{
+  const auto v = command->getRawScore() - average;
+  if(v <= 0.0 || se <= 0.0) return 0.5;
+
+  return std::min(1.0, ((10 * v) / se + 50) / 100.0);
+} // }}}
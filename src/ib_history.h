@@ -4,39 +4,186 @@
 #include "ib_constants.h"
 #include "ib_utils.h"
 #include "ib_comp_value.h"
+#include "ib_platform.h"
 #include "ib_regex.h"
 #include "ib_singleton.h"
 
 namespace ib {
+  ib::threadret _history_log_thread(void *p);
+
+  // An append-only log of executed commands.
+  //
+  // The log starts with MAGIC and a version number followed by records:
+  //   checksum(u32) name size(u32) path size(u32) time(u32 high, u32 low) name path
+  // All integers are big-endian. The checksum is FNV-1a of the rest of the record.
+  //
+  // Records are flushed to the OS when they are appended, and a background
+  // thread syncs them to the disk in batches and rewrites the log when
+  // it is compacted.
+  class HistoryLog : private NonCopyable<HistoryLog> { // {{{
+    friend ib::threadret _history_log_thread(void *p);
+    public:
+      static const char MAGIC[];
+      static const ib::u32 VERSION = 1;
+      static const std::size_t HEADER_SIZE = 8;
+      static const std::size_t RECORD_HEADER_SIZE = 20;
+      // syncs appended records at least every SYNC_INTERVAL(ms).
+      static const int SYNC_INTERVAL = 1000;
+
+      HistoryLog() : path_(), fp_(nullptr), record_count_(0), unsynced_count_(0), running_(0), compaction_(), compaction_count_(0), is_compacting_(false), pending_(), pending_count_(0), unwritten_(), is_reopen_failed_(false), retry_count_(0), error_(), thread_(), cmutex_(), cond_() {}
+      ~HistoryLog() { close(); }
+
+      int open(const std::string &path, const std::size_t record_count, ib::Error &error);
+      void close();
+      void append(const std::string &record);
+      // rewrites the log with given records(which must start with a header) on the background thread.
+      void compact(std::string &records, const std::size_t count);
+      std::size_t getRecordCount();
+      bool isCompacting();
+      // true if the log has more records than the threshold and is not
+      // being compacted. After a compaction fails, this waits until the
+      // log gets twice as large.
+      bool needsCompaction(const std::size_t threshold);
+      // returns true and sets the error if the background thread has
+      // failed since the last call.
+      bool getError(ib::Error &error);
+
+      static void writeHeader(std::string &buf);
+      static bool readHeader(const char *data, const std::size_t size);
+      static void writeRecord(std::string &buf, const std::string &name, const std::string &path, const std::time_t time);
+      // returns a pointer to the next record, or nullptr if the record is truncated or broken.
+      static const char* readRecord(const char *data, const char *end, ib::StringView &name, ib::StringView &path, std::time_t &time);
+
+    protected:
+      void run();
+      int doCompaction();
+      void reopen();
+
+      std::string path_;
+      std::FILE *fp_;
+      std::size_t record_count_;
+      std::size_t unsynced_count_;
+      int running_;
+
+      std::string compaction_;
+      std::size_t compaction_count_;
+      bool is_compacting_;
+      // records appended during the compaction
+      std::string pending_;
+      std::size_t pending_count_;
+      // records appended while the log can not be reopened. the
+      // background thread retries to reopen it.
+      std::string unwritten_;
+      bool is_reopen_failed_;
+      // the number of records to retry a failed compaction at.
+      std::size_t retry_count_;
+      std::string error_;
+
+      ib::thread thread_;
+      ib::cmutex cmutex_;
+      ib::condition cond_;
+  }; // }}}
+
+  // An index of history commands by case-insensitive paths.
+  // A compressed trie finds paths that begin with a string, and
+  // trigrams find paths that may contain a string.
+  class HistoryIndex : private NonCopyable<HistoryIndex> { // {{{
+    public:
+      HistoryIndex() : root_(new Node()), trigrams_() {}
+      ~HistoryIndex() { delete root_; }
+
+      void add(ib::HistoryCommand *command);
+      void remove(ib::HistoryCommand *command);
+      // appends commands whose paths begin with the prefix.
+      void findPrefix(std::vector<ib::HistoryCommand*> &result, const std::string &prefix) const;
+      // appends commands whose paths may contain the string. returns
+      // false if the string is too short to be searched by the index.
+      bool findSubstring(std::vector<ib::HistoryCommand*> &result, const std::string &value) const;
+
+    protected:
+      class Node : private NonCopyable<Node> { // {{{
+        public:
+          Node() : label(), children(), commands() {}
+          ~Node() { for(auto &c : children) { delete c; } }
+          Node* findChild(const char c) const;
+
+          std::string label;
+          std::vector<Node*> children;
+          std::vector<ib::HistoryCommand*> commands;
+      }; // }}}
+
+      static std::string toKey(const std::string &value);
+      static ib::u32 toTrigram(const char *value);
+
+      Node *root_;
+      std::unordered_map<ib::u32, std::unordered_set<ib::HistoryCommand*>> trigrams_;
+  }; // }}}
+
   class History : private NonCopyable<History>{ // {{{
     friend class ib::Singleton<History>;
     public:
       ~History() {
-        for(auto &c : ordered_commands_) { delete c;}
+        for(auto &c : recent_commands_) { delete c;}
+        freeRetiredCommands();
       }
       void load();
+      // syncs the log to the disk and stops the background thread.
       void dump();
 
-      const std::vector<ib::HistoryCommand*>& getOrderedCommands() const { return ordered_commands_; }
-      const std::unordered_map<std::string, ib::HistoryCommand*>& getCommands() const { return commands_; }
+      // unique commands ordered by the last execution(newest first).
+      const std::list<ib::HistoryCommand*>& getRecentCommands() const { return recent_commands_; }
       void addCommand(ib::HistoryCommand *command);
       void addBaseCommandHistory(const std::string &value, const ib::BaseCommand* cmd);
       void addRawInputHistory(const std::string &value);
-      void calcRawScore(ib::HistoryCommand *command);
+      // finds candidates by the index(newest first). returns false if
+      // the method can not use the index.
+      bool findCandidates(std::vector<ib::HistoryCommand*> &result, const int method, const std::string &input) const;
       double calcScore(const std::string &name, double average, double se);
-      double calcScoreSe();
+      double calcScore(const ib::HistoryCommand *command, double average, double se);
+      double calcScoreSe() const { return score_count_ == 0 ? 0.0 : std::sqrt(std::max(0.0, score_m2_) / score_count_); }
+      double getAverageScore() const { return score_mean_; }
+      // deletes commands removed from the history. The completion list
+      // calls this after it has cleared the values, since they may have
+      // been shown in the list.
+      void freeRetiredCommands();
 
-      long getTotalScore() const { return total_score_; }
-      void setTotalScore(const long value){ total_score_ = value; }
+    protected:
+      // half-life of the frecency of commands in seconds.
+      static const int FRECENCY_HALF_LIFE = 60*60*24*3;
 
-      double getAverageScore() const { return total_score_ / (double)commands_.size(); }
+      History() : commands_(), recent_commands_(), retired_commands_(), index_(), recency_(0), executions_(), executions_head_(0), log_(), frecency_epoch_(std::time(0)), score_count_(0), score_mean_(0.0), score_m2_(0.0) {}
+      std::size_t replayLog(const char *data, const std::size_t size, std::size_t &record_count);
+      std::size_t importTextHistory(const ib::oschar *path);
+      void appendLog(const std::string &name, const std::string &path, const std::time_t time);
+      void compactLog();
+      void pushExecution(ib::HistoryCommand *command, const std::time_t time);
+      void removeExecution(ib::HistoryCommand *command, const std::time_t time);
+      double frecencyWeight(const std::time_t time) const;
+      void updateRawScore(ib::HistoryCommand *command, const double value, const bool is_counted);
+      void addScoreStat(const double value);
+      void removeScoreStat(const double value);
+      void rebaseFrecency();
 
-    protected:
-      History() : commands_(), ordered_commands_(), total_score_(0) {}
+      // path -> position in recent_commands_
+      std::unordered_map<std::string, std::list<ib::HistoryCommand*>::iterator> commands_;
+      std::list<ib::HistoryCommand*> recent_commands_;
+      // commands removed from the history that are not deleted yet.
+      std::vector<ib::HistoryCommand*> retired_commands_;
+      ib::HistoryIndex index_;
+      std::size_t recency_;
+      // a ring buffer of the last max_histories executions.
+      std::vector<std::pair<ib::HistoryCommand*, std::time_t>> executions_;
+      std::size_t executions_head_;
+      ib::HistoryLog log_;
 
-      std::unordered_map<std::string, ib::HistoryCommand*> commands_;
-      std::vector<ib::HistoryCommand*> ordered_commands_;
-      long total_score_;
+      // Raw scores are exponentially decayed counts relative to
+      // frecency_epoch_. All raw scores decay at the same rate, so scores
+      // normalized by the mean and the standard deviation do not drift.
+      std::time_t frecency_epoch_;
+      // running statistics of raw scores(Welford's algorithm)
+      std::size_t score_count_;
+      double score_mean_;
+      double score_m2_;
   }; // }}}
 
 }
@@ -5,149 +5,502 @@
 #include "ib_regex.h"
 #include "ib_config.h"
 #include "ib_svg.h"
+#include "ib_image.h"
 #include "ib_singleton.h"
 
-// icon_loader_thread {{{
-struct iconlist {
-  std::vector<Fl_Image*> icons;
-  int pos;
-};
-
+// class IconLoader {{{
 static void _main_thread_awaker(void *p){
-  const auto listbox = ib::Singleton<ib::ListWindow>::getInstance()->getListbox();
-  auto ilist = reinterpret_cast<struct iconlist*>(p);
-  auto pos = ilist->pos;
-  for(auto it = ilist->icons.begin(), last = ilist->icons.end(); it != last; ++it, ++pos){
-    listbox->destroyIcon(pos);
-    if(*it != nullptr) {
-      listbox->icon(pos, *it);
-    }
-  }
-  delete ilist;
+  reinterpret_cast<ib::IconLoader*>(p)->drainResults();
 }
 
-void ib::_icon_loader(void *p) {
-  const int MAX_FLUSH = 200;
+ib::threadret ib::_icon_loader_thread(void *p) { // {{{
+  auto worker = reinterpret_cast<ib::IconLoader::Worker*>(p);
+  worker->loader->run(worker);
+  ib::platform::exit_thread(0);
+  return (ib::threadret)0;
+} // }}}
 
-  const auto listbox = ib::Singleton<ib::ListWindow>::getInstance()->getListbox();
+void ib::IconLoader::startThreads(const int count) { // {{{
+  if(running_ != 0) return;
+  ib::platform::create_cmutex(&cmutex_);
+  running_ = 1;
+  for(int i = 0; i < std::max<int>(count, 1); ++i) {
+    auto worker = new Worker(this);
+    ib::platform::create_condition(&worker->cond);
+    workers_.push_back(worker);
+    ib::platform::create_thread(&worker->thread, &ib::_icon_loader_thread, worker);
+  }
+} // }}}
 
-  std::vector<Fl_Image*> buf;
-  int current_operation_count = -1;
-  int listsize;
-  int pos;
-  int loaded_to_flush;
+void ib::IconLoader::stopThreads() { // {{{
+  if(running_ == 0) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  running_ = 0;
+  notifyWorkers();
+  ib::platform::unlock_cmutex(&cmutex_);
+  for(auto &worker : workers_) {
+    ib::platform::join_thread(&worker->thread);
+    ib::platform::destroy_condition(&worker->cond);
+    LoadedIcon loaded;
+    while(worker->results.pop(loaded)) { ib::Singleton<ib::IconManager>::getInstance()->releaseIcon(loaded.icon); }
+    delete worker;
+  }
+  workers_.clear();
+  ib::platform::destroy_cmutex(&cmutex_);
+  requests_.clear();
+  queue_.clear();
+} // }}}
 
-  { ib::platform::ScopedLock lock(listbox->getMutex());
-    current_operation_count = listbox->getOperationCount();
-    listsize = listbox->size();
-    pos = 1;
-    loaded_to_flush= 2;
+void ib::IconLoader::load(const int operation_count, std::vector<ib::IconRequest> &requests, const int first_line, const int last_line, const int selected_line) { // {{{
+  if(running_ == 0) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  operation_count_ = operation_count;
+  requests_.swap(requests);
+  first_line_ = first_line;
+  last_line_ = last_line;
+  selected_line_ = selected_line;
+  queue_.clear();
+  for(int line = 1, last = (int)requests_.size(); line <= last; ++line) {
+    queue_.push_back(line);
+  }
+  std::make_heap(queue_.begin(), queue_.end(), [this](const int a, const int b) { return comparePriority(a, b); });
+  notifyWorkers();
+  ib::platform::unlock_cmutex(&cmutex_);
+} // }}}
+
+void ib::IconLoader::clear() { // {{{
+  if(running_ == 0) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  operation_count_ = -1;
+  requests_.clear();
+  queue_.clear();
+  // workers waiting in publish drop their stale icons.
+  notifyWorkers();
+  ib::platform::unlock_cmutex(&cmutex_);
+} // }}}
+
+void ib::IconLoader::setViewport(const int first_line, const int last_line, const int selected_line) { // {{{
+  if(running_ == 0) return;
+  ib::platform::lock_cmutex(&cmutex_);
+  if(first_line != first_line_ || last_line != last_line_ || selected_line != selected_line_) {
+    first_line_ = first_line;
+    last_line_ = last_line;
+    selected_line_ = selected_line;
+    std::make_heap(queue_.begin(), queue_.end(), [this](const int a, const int b) { return comparePriority(a, b); });
+    notifyWorkers();
   }
+  ib::platform::unlock_cmutex(&cmutex_);
+} // }}}
 
-  for(int i=1;i <= listsize; ++i){
-    { ib::platform::ScopedLock lock(listbox->getMutex());
-      if(current_operation_count != listbox->getOperationCount()){ break; }
-      int icon_size = listbox->getValues().at(i-1)->hasDescription() ? IB_ICON_SIZE_LARGE : IB_ICON_SIZE_SMALL;
-      buf.push_back(listbox->getValues().at(i-1)->loadIcon(icon_size));
+void ib::IconLoader::drainResults() { // {{{
+  // results published after this line queue another drain.
+  is_drain_queued_.exchange(false);
+  const auto listbox = ib::Singleton<ib::ListWindow>::getInstance()->getListbox();
+  for(auto &worker : workers_) {
+    LoadedIcon loaded;
+    bool drained = false;
+    while(worker->results.pop(loaded)) {
+      drained = true;
+      // the list may have been changed after the icon was published.
+      if(loaded.operation_count != listbox->getOperationCount() || loaded.line > listbox->size()){
+        ib::Singleton<ib::IconManager>::getInstance()->releaseIcon(loaded.icon);
+        continue;
+      }
+      listbox->destroyIcon(loaded.line);
+      if(loaded.icon != nullptr) {
+        listbox->icon(loaded.line, loaded.icon);
+      }
+    }
+    if(drained) {
+      // wakes the worker if it is waiting for a free slot in publish.
+      ib::platform::lock_cmutex(&cmutex_);
+      ib::platform::notify_condition(&worker->cond);
+      ib::platform::unlock_cmutex(&cmutex_);
     }
+  }
+} // }}}
 
-    if((i != 1 && (i-pos) % loaded_to_flush == 0) || i == listsize){
-      { ib::platform::ScopedLock lock(listbox->getMutex());
-        if(current_operation_count != listbox->getOperationCount()){
-          ib::utils::delete_pointer_vectors(buf);
-          break;
-        }
-        auto ilist = new iconlist;
-        std::copy(buf.begin(), buf.end(), std::back_inserter(ilist->icons));
-        ilist->pos = pos;
-        Fl::awake(_main_thread_awaker, ilist);
-        pos += buf.size();
-        buf.clear();
-        loaded_to_flush = std::min<int>(loaded_to_flush*3, MAX_FLUSH);
-      }
+void ib::IconLoader::run(ib::IconLoader::Worker *worker) { // {{{
+  ib::platform::on_thread_start();
+  const auto icon_manager = ib::Singleton<ib::IconManager>::getInstance();
+  const auto compare = [this](const int a, const int b) { return comparePriority(a, b); };
+  ib::platform::lock_cmutex(&cmutex_);
+  while(running_) {
+    const auto prefetch = (last_line_ - first_line_ + 1) * PREFETCH_PAGES;
+    if(queue_.empty() || getDistance(queue_.front()) > prefetch) {
+      ib::platform::wait_condition(&worker->cond, &cmutex_, 0);
+      continue;
     }
+    std::pop_heap(queue_.begin(), queue_.end(), compare);
+    const auto line = queue_.back();
+    queue_.pop_back();
+    const auto request = requests_.at(line-1);
+    const auto operation_count = operation_count_;
+
+    ib::platform::unlock_cmutex(&cmutex_);
+    auto icon = icon_manager->loadIcon(request);
+    ib::platform::lock_cmutex(&cmutex_);
+    publish(worker, operation_count, line, icon);
   }
+  ib::platform::unlock_cmutex(&cmutex_);
 } // }}}
 
+void ib::IconLoader::notifyWorkers() { // {{{
+  for(auto &worker : workers_) {
+    ib::platform::notify_condition(&worker->cond);
+  }
+} // }}}
+
+int ib::IconLoader::getDistance(const int line) const { // {{{
+  if(line == selected_line_) return -1;
+  if(line < first_line_) return first_line_ - line;
+  if(line > last_line_) return line - last_line_;
+  return 0;
+} // }}}
+
+bool ib::IconLoader::comparePriority(const int a, const int b) const { // {{{
+  // std heaps are max-heaps, so nearer lines are "greater".
+  const auto da = getDistance(a);
+  const auto db = getDistance(b);
+  if(da != db) return da > db;
+  return a > b;
+} // }}}
+
+void ib::IconLoader::publish(ib::IconLoader::Worker *worker, const int operation_count, const int line, Fl_Image *icon) { // {{{
+  while(1) {
+    // stale icons are freed here, not on the main thread.
+    if(!running_ || operation_count != operation_count_) {
+      ib::Singleton<ib::IconManager>::getInstance()->releaseIcon(icon);
+      return;
+    }
+    if(worker->results.push(LoadedIcon(operation_count, line, icon))) break;
+    // the main thread has not drained the results yet. drainResults
+    // notifies this worker after it has popped them.
+    queueDrain();
+    ib::platform::wait_condition(&worker->cond, &cmutex_, 0);
+  }
+  queueDrain();
+} // }}}
+
+void ib::IconLoader::queueDrain() { // {{{
+  // one drain is queued for all results published until it runs.
+  if(!is_drain_queued_.exchange(true) && Fl::awake(_main_thread_awaker, this) != 0) {
+    is_drain_queued_.store(false);
+  }
+} // }}}
+// }}}
+
 void ib::IconManager::loadCompletionListIcons() { // {{{
-  loader_event_.queueEvent((void*)1);
+  const auto listbox = ib::Singleton<ib::ListWindow>::getInstance()->getListbox();
+  std::vector<ib::IconRequest> requests;
+  int operation_count;
+  int first_line, last_line;
+  { ib::platform::ScopedLock lock(listbox->getMutex());
+    operation_count = listbox->getOperationCount();
+    const auto &values = listbox->getValues();
+    for(int i=1, last = listbox->size(); i <= last; ++i){
+      const auto value = values.at(i-1);
+      requests.push_back(ib::IconRequest(value->hasDescription() ? IB_ICON_SIZE_LARGE : IB_ICON_SIZE_SMALL));
+      value->getIconRequest(requests.back());
+    }
+    listbox->getVisibleLines(first_line, last_line);
+  }
+  loader_.load(operation_count, requests, first_line, last_line, listbox->value());
+} // }}}
+
+struct IconPreloadTask {
+  const std::vector<ib::IconRequest> *requests;
+  std::atomic<std::size_t> next;
+};
+
+static ib::threadret _icon_preload_thread(void *p) { // {{{
+  auto task = reinterpret_cast<IconPreloadTask*>(p);
+  ib::platform::on_thread_start();
+  const auto icon_manager = ib::Singleton<ib::IconManager>::getInstance();
+  // icons are only evicted when the completion list is cleared, so
+  // preloading stops when the cache is full instead of growing it.
+  for(auto i = task->next++; i < task->requests->size() && !icon_manager->isCacheFull(); i = task->next++) {
+    icon_manager->releaseIcon(icon_manager->loadIcon(task->requests->at(i)));
+  }
+  ib::platform::exit_thread(0);
+  return (ib::threadret)0;
 } // }}}
 
+static void _icon_cache_shrinker(void *p) {
+  reinterpret_cast<ib::IconManager*>(p)->shrinkCache();
+}
+
+void ib::IconManager::preloadIcons(const std::vector<ib::IconRequest> &requests, const int threads) { // {{{
+  IconPreloadTask task;
+  task.requests = &requests;
+  task.next = 0;
+  std::vector<ib::thread> workers(std::max<int>(threads, 1));
+  for(auto &worker : workers) {
+    ib::platform::create_thread(&worker, _icon_preload_thread, &task);
+  }
+  for(auto &worker : workers) {
+    ib::platform::join_thread(&worker);
+  }
+  // each thread may have cached an icon after the cache got full. Evicted
+  // icons may have been drawn, so they are freed on the main thread.
+  Fl::awake(_icon_cache_shrinker, this);
+} // }}}
+
+// icon cache file stuff {{{
+const char ib::IconManager::CACHE_MAGIC[] = "IBIC";
+const int ib::IconManager::MISSING_ICON_TTL;
+const std::size_t ib::IconManager::CACHE_HEADER_SIZE;
+
+static void append_u32(std::string &buf, const ib::u32 value) {
+  char bytes[4];
+  ib::utils::u32int2bebytes(bytes, value);
+  buf.append(bytes, 4);
+}
+
+// An index entry is "key_size key offset width height depth size" and a
+// record in the append region is "key_size key width height depth size pixels".
+// Pixels of indexed icons must be in [data_begin, data_end) of the file.
+// Returns nullptr if the entry is broken.
+static const char* read_icon_entry(std::string &key, ib::MappedIcon &icon, const char *data, const char *ptr, const char *end, const std::size_t data_begin, const std::size_t data_end, const bool indexed) {
+  if(end - ptr < 4) return nullptr;
+  const auto key_size = (std::size_t)ib::utils::bebytes2u32int(ptr);
+  ptr += 4;
+  const std::size_t fields = indexed ? 5 : 4;
+  if((std::size_t)(end - ptr) < key_size + fields * 4) return nullptr;
+  key.assign(ptr, key_size);
+  ptr += key_size;
+
+  std::size_t offset = 0;
+  if(indexed) {
+    offset = (std::size_t)ib::utils::bebytes2u32int(ptr);
+    ptr += 4;
+  }
+  const auto width = (int)ib::utils::bebytes2u32int(ptr);
+  const auto height = (int)ib::utils::bebytes2u32int(ptr + 4);
+  const auto depth = (int)ib::utils::bebytes2u32int(ptr + 8);
+  const auto size = ib::utils::bebytes2u32int(ptr + 12);
+  ptr += 16;
+  if(width <= 0 || height <= 0 || depth <= 0 || depth > 4 || width > 4096 || height > 4096) return nullptr;
+  if(size == 0 || (std::size_t)size > (std::size_t)width * height * depth) return nullptr;
+
+  if(!indexed) {
+    offset = ptr - data;
+    if((std::size_t)(end - ptr) < size) return nullptr;
+    ptr += size;
+  } else if(offset < data_begin || offset > data_end || data_end - offset < size) {
+    return nullptr;
+  }
+  icon = ib::MappedIcon(reinterpret_cast<const unsigned char*>(data + offset), size, width, height, depth);
+  return ptr;
+}
+
+// Returns the bytes to store for the icon. Pixels are deflated into
+// `buffers` if compression is enabled and it makes them smaller.
+static ib::MappedIcon encode_icon(std::deque<std::string> &buffers, const Fl_RGB_Image *icon, const bool compress) {
+  const auto size = (ib::u32)(icon->data_w() * icon->data_h() * icon->d());
+  const auto data = reinterpret_cast<const unsigned char*>(icon->array);
+  if(compress) {
+    auto bound = compressBound(size);
+    std::string buf(bound, '\0');
+    if(compress2(reinterpret_cast<Bytef*>(&buf[0]), &bound, data, size, Z_DEFAULT_COMPRESSION) == Z_OK && bound < size) {
+      buf.resize(bound);
+      buffers.push_back(std::string());
+      buffers.back().swap(buf);
+      return ib::MappedIcon(reinterpret_cast<const unsigned char*>(buffers.back().data()), (ib::u32)bound, icon->data_w(), icon->data_h(), icon->d());
+    }
+  }
+  return ib::MappedIcon(data, size, icon->data_w(), icon->data_h(), icon->d());
+}
+
 void ib::IconManager::load() { // {{{
   ib::platform::ScopedLock lock(&cache_mutex_);
   const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
   auto osicon_path = ib::platform::utf82oschar(cfg->getIconCachePath().c_str());
-  if(!ib::platform::file_exists(osicon_path.get())) return;
-
-  auto loicon_path = ib::platform::utf82local(cfg->getIconCachePath().c_str());
-  std::ifstream ifs(loicon_path.get(), std::ios::in|std::ios::binary);
 
   deleteCachedIcons();
-  int count;
-  ifs.read((char*)&count, sizeof(int));
-  for(int i = 0; i < count; ++i){
-    int w;
-    ifs.read((char*)&w, sizeof(int));
-    int h;
-    ifs.read((char*)&h, sizeof(int));
-    int d;
-    ifs.read((char*)&d, sizeof(int));
-
-    std::string::size_type cache_key_size;
-    ifs.read((char*)&cache_key_size, sizeof(std::string::size_type));
-    auto cache_key_buf = new char[cache_key_size];
-    ifs.read(cache_key_buf, cache_key_size);
-
-    long data_size;
-    ifs.read((char*)&data_size, sizeof(long));
-    auto data_buf = new unsigned char[data_size];
-    ifs.read((char*)data_buf, data_size);
+  mapped_icons_.clear();
+  cache_file_.close();
+  indexed_icons_ = 0;
+  appended_icons_ = 0;
+  needs_compaction_ = true;
+  if(!ib::platform::file_exists(osicon_path.get())) return;
 
-    std::string cache_key(cache_key_buf);
-    delete[] cache_key_buf;
-    auto icon = new Fl_RGB_Image(data_buf, w, h ,d);
-    icon->alloc_array = true;
-    createIconCache(cache_key, icon);
+  ib::Error error;
+  if(cache_file_.open(osicon_path.get(), error) != 0) return;
+  const auto data = cache_file_.getData();
+  const auto end = data + cache_file_.getSize();
+  if(cache_file_.getSize() < CACHE_HEADER_SIZE || memcmp(data, CACHE_MAGIC, 4) != 0 ||
+     ib::utils::bebytes2u32int(data + 4) != CACHE_VERSION) {
+    cache_file_.close();
+    return;
+  }
+  const auto index_offset = (std::size_t)ib::utils::bebytes2u32int(data + 8);
+  const auto index_count = (std::size_t)ib::utils::bebytes2u32int(data + 12);
+  if(index_offset < CACHE_HEADER_SIZE || index_offset > cache_file_.getSize()) {
+    cache_file_.close();
+    return;
   }
-  ifs.close();
 
+  std::string key;
+  ib::MappedIcon icon;
+  const char *ptr = data + index_offset;
+  for(std::size_t i = 0; i < index_count; ++i) {
+    ptr = read_icon_entry(key, icon, data, ptr, end, CACHE_HEADER_SIZE, index_offset, true);
+    if(ptr == nullptr) {
+      mapped_icons_.clear();
+      cache_file_.close();
+      return;
+    }
+    mapped_icons_[key] = icon;
+  }
+  indexed_icons_ = mapped_icons_.size();
+
+  // a torn record at the end is ignored, and the file will be rewritten.
+  while(ptr < end) {
+    auto next = read_icon_entry(key, icon, data, ptr, end, 0, 0, false);
+    if(next == nullptr) break;
+    mapped_icons_[key] = icon;
+    appended_icons_++;
+    ptr = next;
+  }
+  needs_compaction_ = ptr != end;
 } // }}}
 
 void ib::IconManager::dump() { // {{{
+  // the application exits after this, so icons are no longer loaded.
+  loader_.stopThreads();
   ib::platform::ScopedLock lock(&cache_mutex_);
   const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
-  auto loicon_path = ib::platform::utf82local(cfg->getIconCachePath().c_str());
-  std::ofstream ofs(loicon_path.get(), std::ios::out|std::ios::binary|std::ios::trunc);
-  int intvalue;
-  char *intptr = (char*)&intvalue;
+  const auto &path = cfg->getIconCachePath();
 
-  // cache size
-  intvalue = (int)std::min<std::size_t>(cached_icons_.size(), INT_MAX);
-  ofs.write(intptr, sizeof(int));
+  std::vector<std::string> new_icons;
+  for(auto entry = lru_head_; entry != nullptr; entry = entry->next_) {
+    if(mapped_icons_.find(entry->getKey()) == mapped_icons_.end()) {
+      new_icons.push_back(entry->getKey());
+    }
+  }
+  if(new_icons.empty() && !needs_compaction_) return;
 
-  for(auto const &cache_key : cached_icons_queue_) {
-    Fl_RGB_Image *icon = getIconCache(cache_key);
-    intvalue = icon->w();
-    ofs.write(intptr, sizeof(int));
-    intvalue = icon->h();
-    ofs.write(intptr, sizeof(int));
-    intvalue = icon->d();
-    ofs.write(intptr, sizeof(int));
+  // the append region may grow up to the size of the index.
+  if(needs_compaction_ || appended_icons_ + new_icons.size() > indexed_icons_) {
+    compactCacheFile(path);
+    return;
+  }
 
-    std::string::size_type size = cache_key.size()+1;
-    ofs.write((char*)&size, sizeof(std::string::size_type));
-    ofs.write(cache_key.c_str(), sizeof(char) * (cache_key.size()+1));
+  std::string buf;
+  std::deque<std::string> buffers;
+  auto fp = std::fopen(ib::platform::utf82local(path.c_str()).get(), "ab");
+  if(fp == nullptr) return;
+  for(auto const &cache_key : new_icons) {
+    const auto icon = encode_icon(buffers, cached_icons_[cache_key]->getIcon(), cfg->getIconCacheCompression());
+    buf.clear();
+    append_u32(buf, (ib::u32)cache_key.size());
+    buf += cache_key;
+    append_u32(buf, (ib::u32)icon.getWidth());
+    append_u32(buf, (ib::u32)icon.getHeight());
+    append_u32(buf, (ib::u32)icon.getDepth());
+    append_u32(buf, icon.getSize());
+    if(std::fwrite(buf.data(), 1, buf.size(), fp) != buf.size() ||
+       std::fwrite(icon.getData(), 1, icon.getSize(), fp) != icon.getSize()) {
+      break;
+    }
+    buffers.clear();
+    appended_icons_++;
+  }
+  std::fclose(fp);
+} // }}}
 
-    long lsize = sizeof(char) * icon->w() * icon->h() * icon->d();
-    ofs.write((char*)&lsize, sizeof(long));
-    ofs.write((char*)icon->array, lsize);
+// Rewrites the cache file with icons in memory first(most recently used
+// first), then icons that are only in the file, up to max_cached_icons.
+// This must be the last operation on the cache, because icons that are
+// mapped from the old file are released.
+void ib::IconManager::compactCacheFile(const std::string &path) { // {{{
+  const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
+  const auto max_icons = (std::size_t)cfg->getMaxCachedIcons();
+  std::vector<std::pair<std::string, ib::MappedIcon> > icons;
+  std::unordered_set<std::string> keys;
+  std::deque<std::string> buffers;
+  for(auto entry = lru_head_; entry != nullptr && icons.size() < max_icons; entry = entry->next_) {
+    const auto &cache_key = entry->getKey();
+    keys.insert(cache_key);
+    // icons from the file are copied as stored.
+    auto mit = mapped_icons_.find(cache_key);
+    if(mit != mapped_icons_.end()) {
+      icons.push_back(*mit);
+    } else {
+      icons.push_back(std::make_pair(cache_key, encode_icon(buffers, entry->getIcon(), cfg->getIconCacheCompression())));
+    }
+  }
+  for(auto const &pair : mapped_icons_) {
+    if(icons.size() >= max_icons) break;
+    if(!keys.insert(pair.first).second) continue;
+    icons.push_back(pair);
+  }
+
+  ib::Error error;
+  auto tmp_path = path + ".tmp";
+  auto ostmp_path = ib::platform::utf82oschar(tmp_path.c_str());
+  auto fp = std::fopen(ib::platform::utf82local(tmp_path.c_str()).get(), "wb");
+  if(fp == nullptr) return;
+
+  std::string header(CACHE_MAGIC, 4);
+  append_u32(header, CACHE_VERSION);
+  append_u32(header, 0);
+  append_u32(header, 0);
+  auto ok = std::fwrite(header.data(), 1, header.size(), fp) == header.size();
+
+  std::string index;
+  std::size_t offset = CACHE_HEADER_SIZE;
+  for(auto const &pair : icons) {
+    if(!ok) break;
+    const auto &icon = pair.second;
+    append_u32(index, (ib::u32)pair.first.size());
+    index += pair.first;
+    append_u32(index, (ib::u32)offset);
+    append_u32(index, (ib::u32)icon.getWidth());
+    append_u32(index, (ib::u32)icon.getHeight());
+    append_u32(index, (ib::u32)icon.getDepth());
+    append_u32(index, icon.getSize());
+    ok = std::fwrite(icon.getData(), 1, icon.getSize(), fp) == icon.getSize();
+    offset += icon.getSize();
+  }
+  if(ok) ok = offset <= 0xffffffffu && std::fwrite(index.data(), 1, index.size(), fp) == index.size();
+  if(ok) {
+    header.resize(8);
+    append_u32(header, (ib::u32)offset);
+    append_u32(header, (ib::u32)icons.size());
+    ok = std::fseek(fp, 0, SEEK_SET) == 0 && std::fwrite(header.data(), 1, header.size(), fp) == header.size();
+  }
+  if(ok) ok = ib::platform::sync_file(fp, error) == 0;
+  std::fclose(fp);
+
+  if(ok) {
+    // the mapped file must be closed before it is replaced on Windows.
+    deleteCachedIcons();
+    mapped_icons_.clear();
+    cache_file_.close();
+    ok = ib::platform::rename_file(ostmp_path.get(), ib::platform::utf82oschar(path.c_str()).get(), error) == 0;
+  }
+  if(!ok) {
+    ib::platform::remove_file(ostmp_path.get(), error); // ignore errors
+  }
+} // }}}
+// }}}
+
+Fl_Image* ib::IconManager::loadIcon(const ib::IconRequest &request){ // {{{
+  switch(request.getType()){
+    case ib::IconRequest::ASSOCIATED:
+      return getAssociatedIcon(request.getPath().c_str(), request.getSize());
+    case ib::IconRequest::IMAGE_FILE:
+      return getImgFileIcon(request.getPath().c_str(), request.getSize());
+    case ib::IconRequest::LUA:
+      return getLuaIcon(request.getSize());
+    default:
+      return nullptr;
   }
-  ofs.close();
 } // }}}
 
 Fl_Image* ib::IconManager::getAssociatedIcon(const char *path, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
-
   const auto scaled_size = ib::utils::scaled_size(size);
 
   std::string cache_key("");
@@ -164,10 +517,19 @@ Fl_Image* ib::IconManager::getAssociatedIcon(const char *path, const int size){
   cache_key += buf;
 
   {
-    Fl_RGB_Image *icon;
-    icon = getIconCache(cache_key);
+    auto icon = findIcon(cache_key, size);
     if(icon != nullptr){
-      return copyCache(icon, size);
+      return icon;
+    }
+  }
+  // paths that do not exist are remembered by the path itself, because
+  // cache keys are shared by files of the same type.
+  std::string path_key(":path:");
+  path_key += path;
+  {
+    ib::platform::ScopedLock lock(&cache_mutex_);
+    if(isMissing(cache_key) || isMissing(path_key)) {
+      return getEmptyIcon(size, size);
     }
   }
 
@@ -180,43 +542,61 @@ Fl_Image* ib::IconManager::getAssociatedIcon(const char *path, const int size){
     }
   }
   if(ib::platform::is_path(os_path) && !ib::platform::path_exists(os_path)) {
+    ib::platform::ScopedLock lock(&cache_mutex_);
+    setMissing(path_key);
     return getEmptyIcon(size, size);
   }
   auto aicon = ib::platform::get_associated_icon_image(os_path, scaled_size);
   if(aicon == nullptr) {
+    ib::platform::ScopedLock lock(&cache_mutex_);
+    setMissing(cache_key);
     return getEmptyIcon(size, size);
   }
   auto ricon = dynamic_cast<Fl_RGB_Image*>(aicon);
   if(ricon != nullptr) {
-    createIconCache(cache_key, ricon); 
-    return copyCache(ricon, size);
+    return publishIcon(cache_key, ricon, size);
   }
 
   aicon->scale(size, size);
   return aicon;
 } // }}}
 
-Fl_Image* ib::IconManager::getImgFileIcon(const char *file, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
-  std::string cache_key;
-
-  const auto scaled_size = ib::utils::scaled_size(size);
-
+static void resolve_icon_path(char *result, const char *file, const int size) { // {{{
   ib::oschar osresolved_path[IB_MAX_PATH];
-  char resolved_path[IB_MAX_PATH_BYTE];
   ib::oschar osfile[IB_MAX_PATH];
   ib::platform::utf82oschar_b(osfile, IB_MAX_PATH, file);
   ib::platform::resolve_icon(osresolved_path, osfile, size);
-  ib::platform::oschar2utf8_b(resolved_path, IB_MAX_PATH_BYTE, osresolved_path);
-  cache_key += resolved_path;
+  ib::platform::oschar2utf8_b(result, IB_MAX_PATH_BYTE, osresolved_path);
+} // }}}
+
+static std::string img_file_cache_key(const char *resolved_path, const int scaled_size) { // {{{
+  std::string cache_key(resolved_path);
   cache_key += "_";
+  // the size is appended as a character, as keys in existing cache files are.
   cache_key += scaled_size;
+  return cache_key;
+} // }}}
+
+Fl_Image* ib::IconManager::getImgFileIcon(const char *file, const int size){ // {{{
+  const auto scaled_size = ib::utils::scaled_size(size);
+
+  char resolved_path[IB_MAX_PATH_BYTE];
+  resolve_icon_path(resolved_path, file, size);
+  const auto cache_key = img_file_cache_key(resolved_path, scaled_size);
   {
-    Fl_RGB_Image *icon = getIconCache(cache_key);
+    auto icon = findIcon(cache_key, size);
     if(icon != nullptr){
-      return copyCache(icon, size);
+      return icon;
     }
   }
+  bool missing;
+  {
+    ib::platform::ScopedLock lock(&cache_mutex_);
+    missing = isMissing(cache_key);
+  }
+  if(missing) {
+    return getAssociatedIcon(file, size);
+  }
 
   Fl_Image *aicon = nullptr;
   ib::Regex re("(.*)\\.(\\w+)", ib::Regex::NONE);
@@ -230,37 +610,38 @@ Fl_Image* ib::IconManager::getImgFileIcon(const char *file, const int size){ //
     }else if(ret == "jpg" || ret == "JPG" || ret == "jpeg" || ret == "JPEG") {
       aicon =  readJpegFileIcon(resolved_path, scaled_size);
     } else if(ret == "svg" || ret == "SVG"){
-      aicon = readSvgFileIcon(resolved_path, scaled_size);
+      aicon = readSvgFileIcon(file, resolved_path, scaled_size);
     } else if(ret == "xpm" || ret == "XPM"){
       aicon = readXpmFileIcon(resolved_path, scaled_size);
     }
   }
   if(aicon != nullptr){
     if(dynamic_cast<Fl_RGB_Image*>(aicon) != nullptr) {
-      createIconCache(cache_key, (Fl_RGB_Image*)aicon); 
-      return copyCache((Fl_RGB_Image*)aicon, size);
+      return publishIcon(cache_key, (Fl_RGB_Image*)aicon, size);
     }
     aicon->scale(size, size);
     return aicon;
   } else {
+    {
+      ib::platform::ScopedLock lock(&cache_mutex_);
+      setMissing(cache_key);
+    }
     return getAssociatedIcon(file, size);
   }
 } // }}}
   
-Fl_RGB_Image* ib::IconManager::getEmbededIcon(const unsigned char *data, const char* cache_prefix, const int embsize, const int reqsize) { // {{{
+ib::SharedIcon* ib::IconManager::getEmbededIcon(const unsigned char *data, const char* cache_prefix, const int embsize, const int reqsize) { // {{{
   ib::platform::ScopedLock lock(&cache_mutex_);
+  const auto scaled_size = ib::utils::scaled_size(reqsize);
   char buf[16] = {};
-  snprintf(buf, 16, ":%s_%d", cache_prefix, reqsize);
+  snprintf(buf, 16, ":%s_%d", cache_prefix, scaled_size);
   const auto cache_key = buf;
-  auto icon = getIconCache(cache_key);
-  if(icon != nullptr) {
-    return copyCache(icon, reqsize);
+  auto entry = getIconCache(cache_key);
+  if(entry == nullptr) {
+    Fl_RGB_Image icon(data, embsize, embsize, 4);
+    entry = createIconCache(cache_key, ib::resize_icon(&icon, scaled_size));
   }
-
-  icon = new Fl_RGB_Image(data, embsize, embsize, 4);
-  icon->alloc_array = false;
-  createIconCache(cache_key, icon);
-  return copyCache(icon, reqsize);
+  return acquireIcon(entry, reqsize, reqsize);
 } // }}}
 
 Fl_Image* ib::IconManager::getEmptyIcon(const int width, const int height) { // {{{
@@ -268,171 +649,347 @@ Fl_Image* ib::IconManager::getEmptyIcon(const int width, const int height) { //
   char buf[24] = {};
   snprintf(buf, 24, "%s%dx%d", ":emp_", width, height);
   const std::string cache_key = buf;
-  Fl_RGB_Image *icon = getIconCache(cache_key);
-  if(icon != nullptr) {
-    auto cp = copyCache(icon, width);
-    cp->scale(width, height);
-    return cp;
+  auto entry = getIconCache(cache_key);
+  if(entry == nullptr) {
+    auto icon = new Fl_RGB_Image(blank_png, IB_ICON_SIZE_LARGE, IB_ICON_SIZE_LARGE, 4);
+    icon->alloc_array = false;
+    entry = createIconCache(cache_key, icon);
   }
-
-  icon = new Fl_RGB_Image(blank_png, IB_ICON_SIZE_LARGE, IB_ICON_SIZE_LARGE, 4);
-  icon->alloc_array = false;
-  createIconCache(cache_key, icon);
-  auto cp = copyCache(icon, width);
-  cp->scale(width, height);
-  return cp;
+  return acquireIcon(entry, width, height);
 } // }}}
 
 Fl_Image* ib::IconManager::getLuaIcon(const int size) { // {{{
   return getEmbededIcon(lua_png, "lua", 128, size);
 } // }}}
 
+// The caller owns the returned icon, since windows of the system tray
+// delete their images.
 Fl_Image* ib::IconManager::getIcebergIcon(const int size) { // {{{
-  return getEmbededIcon(iceberg_png, "iceberg", IB_ICON_SIZE_LARGE, size);
+  auto icon = new Fl_RGB_Image(iceberg_png, IB_ICON_SIZE_LARGE, IB_ICON_SIZE_LARGE, 4);
+  icon->alloc_array = false;
+  icon->scale(size, size);
+  return icon;
 } // }}}
 
-Fl_Image* ib::IconManager::readPngFileIcon(const char *png_file, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
-  auto lopath = ib::platform::utf82local(png_file);
-  Fl_RGB_Image *tmp_image = new Fl_PNG_Image(lopath.get());
-  Fl_Image *result_image;
-  if(tmp_image->w() != size){
-    result_image = tmp_image->copy(size, size);
-    delete tmp_image;
-  }else{
-    result_image = (Fl_Image*)tmp_image;
+// Resizes a loaded image to exactly `size` pixels, so that the icon is
+// not resampled whenever it is drawn. GIF and XPM images are converted to
+// RGB images, so that they can be cached too.
+static Fl_Image* fit_icon_image(Fl_Image *image, const int size) { // {{{
+  if(image->fail()) {
+    delete image;
+    return nullptr;
   }
+  if(dynamic_cast<Fl_RGB_Image*>(image) != nullptr && image->data_w() == size && image->data_h() == size) {
+    return image;
+  }
+  Fl_Image *result_image = ib::resize_icon(image, size);
+  if(result_image == nullptr) {
+    result_image = image->copy(size, size);
+  }
+  delete image;
   return result_image;
 } // }}}
 
+Fl_Image* ib::IconManager::readPngFileIcon(const char *png_file, const int size){ // {{{
+  auto lopath = ib::platform::utf82local(png_file);
+  return fit_icon_image(new Fl_PNG_Image(lopath.get()), size);
+} // }}}
+
 Fl_Image* ib::IconManager::readJpegFileIcon(const char *jpeg_file, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
   auto lopath = ib::platform::utf82local(jpeg_file);
-  Fl_RGB_Image *tmp_image = new Fl_JPEG_Image(lopath.get());
-  Fl_Image *result_image;
-  if(tmp_image->w() != size){
-    result_image = tmp_image->copy(size, size);
-    delete tmp_image;
-  }else{
-    result_image = (Fl_Image*)tmp_image;
-  }
-  return result_image;
+  return fit_icon_image(new Fl_JPEG_Image(lopath.get()), size);
 } // }}}
 
 Fl_Image* ib::IconManager::readGifFileIcon(const char *gif_file, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
   auto lopath = ib::platform::utf82local(gif_file);
-  Fl_Image *tmp_image = new Fl_GIF_Image(lopath.get());
-  Fl_Image *result_image;
-  if(tmp_image->w() != size){
-    result_image = tmp_image->copy(size, size);
-    delete tmp_image;
-  }else{
-    result_image = tmp_image;
-  }
-  return result_image;
+  return fit_icon_image(new Fl_GIF_Image(lopath.get()), size);
 } // }}}
 
-Fl_Image* ib::IconManager::readSvgFileIcon(const char *svg_file, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
-  auto lopath = ib::platform::utf82local(svg_file);
-  auto buf = ib::rasterize_svg_file(svg_file, size);
-  if(buf == nullptr) return nullptr;
-  auto result_image = new Fl_RGB_Image(buf, size, size, 4);
+// The icon is rasterized in the other icon sizes too, if they resolve to
+// the same file and are not cached yet, because parsing the file takes
+// most of the time.
+Fl_Image* ib::IconManager::readSvgFileIcon(const char *file, const char *svg_file, const int size){ // {{{
+  const int icon_sizes[] = {IB_ICON_SIZE_SMALL, IB_ICON_SIZE_LARGE};
+  std::vector<int> sizes(1, size);
+  std::vector<int> display_sizes(1, 0);
+  std::vector<std::string> cache_keys(1, "");
+  for(auto icon_size : icon_sizes) {
+    const auto scaled_size = ib::utils::scaled_size(icon_size);
+    if(std::find(sizes.begin(), sizes.end(), scaled_size) != sizes.end()) continue;
+    char resolved_path[IB_MAX_PATH_BYTE];
+    resolve_icon_path(resolved_path, file, icon_size);
+    if(strcmp(resolved_path, svg_file) != 0) continue;
+    const auto cache_key = img_file_cache_key(resolved_path, scaled_size);
+    {
+      ib::platform::ScopedLock lock(&cache_mutex_);
+      if(isCached(cache_key) || mapped_icons_.find(cache_key) != mapped_icons_.end()) continue;
+    }
+    sizes.push_back(scaled_size);
+    display_sizes.push_back(icon_size);
+    cache_keys.push_back(cache_key);
+  }
+
+  std::vector<unsigned char*> buffers;
+  svg_cache_.rasterize(svg_file, sizes, buffers);
+  for(std::size_t i = 1; i < buffers.size(); ++i) {
+    if(buffers[i] == nullptr) continue;
+    auto icon = new Fl_RGB_Image(buffers[i], sizes[i], sizes[i], 4);
+    icon->alloc_array = 1;
+    releaseIcon(publishIcon(cache_keys[i], icon, display_sizes[i]));
+  }
+  if(buffers[0] == nullptr) return nullptr;
+  auto result_image = new Fl_RGB_Image(buffers[0], size, size, 4);
+  result_image->alloc_array = 1;
   return static_cast<Fl_Image*>(result_image);
 } // }}}
 
 Fl_Image* ib::IconManager::readXpmFileIcon(const char *xpm_file, const int size){ // {{{
-  ib::platform::ScopedLock lock(&cache_mutex_);
   auto lopath = ib::platform::utf82local(xpm_file);
-  Fl_Image *tmp_image = new Fl_XPM_Image(lopath.get());
-  Fl_Image *result_image;
-  if(tmp_image->w() != size){
-    result_image = tmp_image->copy(size, size);
-    delete tmp_image;
-  }else{
-    result_image = tmp_image;
-  }
-  return result_image;
+  return fit_icon_image(new Fl_XPM_Image(lopath.get()), size);
 } // }}}
 
+// Pinned entries are kept. Their pixels are copied if they are in the
+// cache file, because the file is closed after this is called.
 void ib::IconManager::deleteCachedIcons() { // {{{
   ib::platform::ScopedLock lock(&cache_mutex_);
-  for(auto &pair : cached_icons_) {
-    delete pair.second;
+  const auto data_begin = reinterpret_cast<uintptr_t>(cache_file_.getData());
+  const auto data_end = data_begin + cache_file_.getSize();
+  for(auto entry = lru_head_; entry != nullptr;) {
+    auto next = entry->next_;
+    const auto array = reinterpret_cast<uintptr_t>(entry->icon_->array);
+    if(!entry->isPinned()) {
+      deleteIconCache(entry->getKey());
+    } else if(array >= data_begin && array < data_end) {
+      auto icon = static_cast<Fl_RGB_Image*>(entry->icon_->copy(entry->icon_->data_w(), entry->icon_->data_h()));
+      for(auto &shared : entry->shared_icons_) {
+        shared->uncache();
+        shared->array = icon->array;
+      }
+      delete entry->icon_;
+      entry->icon_ = icon;
+    }
+    entry = next;
   }
-  cached_icons_.clear();
-  cached_icons_reverse_.clear();
-  std::deque<std::string> empty;
-  std::swap(cached_icons_queue_, empty);
+  missing_icons_.clear();
 } // }}}
 
+// Entries whose icons are referenced are not evicted, because the icons
+// share pixels with the entries.
 void ib::IconManager::shrinkCache() { // {{{
   ib::platform::ScopedLock lock(&cache_mutex_);
-  const auto max_cache_size = ib::Singleton<ib::Config>::getInstance()->getMaxCachedIcons();
-  if(cached_icons_.size() < max_cache_size) return;
-  if(cached_icons_.size() != cached_icons_queue_.size()){
-    ib::utils::message_box("Warning: icon cache seems to be broken. iceberg clears icon cache.");
-    deleteCachedIcons();
-    return;
+  const auto now = std::chrono::steady_clock::now();
+  for(auto it = missing_icons_.begin(); it != missing_icons_.end();) {
+    if(now >= (*it).second) {
+      it = missing_icons_.erase(it);
+    } else {
+      ++it;
+    }
   }
-  for(std::size_t count = cached_icons_.size() - max_cache_size; count > 0; count--){
-    const auto cache_key = cached_icons_queue_.front();
-    auto icon = getIconCache(cache_key);
-    deleteIconCache(cache_key);
-    delete icon;
-    cached_icons_queue_.pop_front();
+
+  const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
+  const auto max_bytes = (std::size_t)cfg->getIconCacheBytes();
+  const auto max_icons = (std::size_t)cfg->getMaxCachedIcons();
+  for(auto entry = lru_tail_; entry != nullptr && (cached_bytes_ > max_bytes || cached_icons_.size() > max_icons);) {
+    auto prev = entry->prev_;
+    if(!entry->isPinned()) {
+      deleteIconCache(entry->getKey());
+    }
+    entry = prev;
   }
 } // }}} 
 
-void ib::IconManager::createIconCache(const std::string &cache_key, Fl_RGB_Image *icon){ // {{{
-  if(isCached(cache_key)) return;
-  cached_icons_[cache_key] = icon;
-  cached_icons_reverse_[icon] = cache_key;
-  cached_icons_queue_.push_back(cache_key);
+void ib::IconManager::getCacheStats(unsigned long long &hits, unsigned long long &misses, std::size_t &bytes, std::size_t &icons) { // {{{
+  ib::platform::ScopedLock lock(&cache_mutex_);
+  hits = cache_hits_;
+  misses = cache_misses_;
+  bytes = cached_bytes_;
+  icons = cached_icons_.size();
 } // }}}
 
-void ib::IconManager::deleteIconCache(const std::string &cache_key) { // {{{
-  if(!isCached(cache_key)) return;
-  Fl_RGB_Image *icon = cached_icons_[cache_key];
-  cached_icons_reverse_.erase(icon);
-  cached_icons_.erase(cache_key);
+bool ib::IconManager::isCacheFull() { // {{{
+  ib::platform::ScopedLock lock(&cache_mutex_);
+  const auto* const cfg = ib::Singleton<ib::Config>::getInstance();
+  return cached_bytes_ >= (std::size_t)cfg->getIconCacheBytes() ||
+         cached_icons_.size() >= (std::size_t)cfg->getMaxCachedIcons();
+} // }}}
+
+void ib::IconManager::linkEntry(ib::IconCacheEntry *entry) { // {{{
+  entry->prev_ = nullptr;
+  entry->next_ = lru_head_;
+  if(lru_head_ != nullptr) lru_head_->prev_ = entry;
+  lru_head_ = entry;
+  if(lru_tail_ == nullptr) lru_tail_ = entry;
 } // }}}
 
-void ib::IconManager::deleteIconCache(Fl_RGB_Image *icon) { // {{{
-  if(!isCached(icon)) return;
-  const auto &cache_key = cached_icons_reverse_[icon];
-  cached_icons_reverse_.erase(icon);
-  cached_icons_.erase(cache_key);
+void ib::IconManager::unlinkEntry(ib::IconCacheEntry *entry) { // {{{
+  if(entry->prev_ != nullptr) entry->prev_->next_ = entry->next_;
+  else lru_head_ = entry->next_;
+  if(entry->next_ != nullptr) entry->next_->prev_ = entry->prev_;
+  else lru_tail_ = entry->prev_;
+  entry->prev_ = nullptr;
+  entry->next_ = nullptr;
 } // }}}
 
-Fl_RGB_Image* ib::IconManager::getIconCache(const std::string &cache_key) { // {{{
+ib::IconCacheEntry* ib::IconManager::createIconCache(const std::string &cache_key, Fl_RGB_Image *icon){ // {{{
+  auto it = cached_icons_.find(cache_key);
+  if(it != cached_icons_.end()) return (*it).second;
+  auto entry = new ib::IconCacheEntry(cache_key, icon);
+  cached_icons_[cache_key] = entry;
+  linkEntry(entry);
+  cached_bytes_ += entry->getBytes();
+  return entry;
+} // }}}
+
+// Deletes the entry and its icon.
+void ib::IconManager::deleteIconCache(const std::string &cache_key) { // {{{
+  auto it = cached_icons_.find(cache_key);
+  if(it == cached_icons_.end()) return;
+  auto entry = (*it).second;
+  cached_icons_.erase(it);
+  unlinkEntry(entry);
+  cached_bytes_ -= entry->getBytes();
+  delete entry;
+} // }}}
+
+ib::IconCacheEntry* ib::IconManager::getIconCache(const std::string &cache_key) { // {{{
   auto it = cached_icons_.find(cache_key);
   if(it != cached_icons_.end()){
-    return (*it).second;
+    auto entry = (*it).second;
+    if(entry != lru_head_) {
+      unlinkEntry(entry);
+      linkEntry(entry);
+    }
+    cache_hits_++;
+    return entry;
   }
+  cache_misses_++;
   return nullptr;
 } // }}}
 
+// Returns a shared icon of the cache entry, or nullptr. Icons in the cache file are
+// wrapped or decompressed on first use. Decompression runs without the lock.
+ib::SharedIcon* ib::IconManager::findIcon(const std::string &cache_key, const int size) { // {{{
+  ib::MappedIcon mapped;
+  // compressed pixels are copied with the lock held, since dump may
+  // unmap the cache file while they are being decompressed.
+  std::vector<unsigned char> compressed;
+  {
+    ib::platform::ScopedLock lock(&cache_mutex_);
+    auto entry = getIconCache(cache_key);
+    if(entry != nullptr) return acquireIcon(entry, size, size);
+
+    auto mit = mapped_icons_.find(cache_key);
+    if(mit == mapped_icons_.end()) return nullptr;
+    mapped = (*mit).second;
+    if(!mapped.isCompressed()) {
+      auto icon = new Fl_RGB_Image(mapped.getData(), mapped.getWidth(), mapped.getHeight(), mapped.getDepth());
+      icon->alloc_array = false;
+      return acquireIcon(createIconCache(cache_key, icon), size, size);
+    }
+    compressed.assign(mapped.getData(), mapped.getData() + mapped.getSize());
+    mapped = ib::MappedIcon(compressed.data(), mapped.getSize(), mapped.getWidth(), mapped.getHeight(), mapped.getDepth());
+  }
+
+  auto icon = decompressIcon(mapped);
+  if(icon == nullptr) {
+    ib::platform::ScopedLock lock(&cache_mutex_);
+    mapped_icons_.erase(cache_key);
+    needs_compaction_ = true;
+    return nullptr;
+  }
+  return publishIcon(cache_key, icon, size);
+} // }}}
+
+// Caches the icon unless another thread has cached an icon for the key
+// while it was being loaded, and returns a shared icon of the entry.
+// The icon is released if it is not cached.
+ib::SharedIcon* ib::IconManager::publishIcon(const std::string &cache_key, Fl_RGB_Image *icon, const int size) { // {{{
+  ib::platform::ScopedLock lock(&cache_mutex_);
+  auto it = cached_icons_.find(cache_key);
+  if(it != cached_icons_.end()) {
+    releaseIcon(icon);
+    return acquireIcon((*it).second, size, size);
+  }
+  auto shared = dynamic_cast<ib::SharedIcon*>(icon);
+  if(shared != nullptr) {
+    // an icon of another entry(e.g. a theme icon of a file type).
+    // entries never share pixels, so that they can be evicted separately.
+    icon = static_cast<Fl_RGB_Image*>(shared->copy(shared->data_w(), shared->data_h()));
+    releaseIcon(shared);
+  }
+  return acquireIcon(createIconCache(cache_key, icon), size, size);
+} // }}}
+
 bool ib::IconManager::isCached(const std::string &cache_key) { // {{{
   return cached_icons_.find(cache_key) != cached_icons_.end();
 } // }}}
 
-bool ib::IconManager::isCached(Fl_RGB_Image *icon){ // {{{
-  return cached_icons_reverse_.find(icon) != cached_icons_reverse_.end();
+Fl_RGB_Image* ib::IconManager::decompressIcon(const ib::MappedIcon &mapped) { // {{{
+  auto size = (uLongf)mapped.getWidth() * mapped.getHeight() * mapped.getDepth();
+  const auto expected = size;
+  auto data = new unsigned char[size];
+  if(uncompress(data, &size, mapped.getData(), mapped.getSize()) != Z_OK || size != expected) {
+    delete[] data;
+    return nullptr;
+  }
+  auto icon = new Fl_RGB_Image(data, mapped.getWidth(), mapped.getHeight(), mapped.getDepth());
+  icon->alloc_array = true;
+  return icon;
 } // }}}
 
-Fl_RGB_Image* ib::IconManager::copyCache(Fl_RGB_Image *image, const int size) { // {{{
-  auto ret = new Fl_RGB_Image(image->array, image->data_w(), image->data_h(), image->d());
-  ret->alloc_array = false;
-  ret->scale(size, size);
-  return ret;
-} // }}} 
+bool ib::IconManager::isMissing(const std::string &cache_key) { // {{{
+  auto it = missing_icons_.find(cache_key);
+  if(it == missing_icons_.end()) return false;
+  if(std::chrono::steady_clock::now() >= (*it).second) {
+    missing_icons_.erase(it);
+    return false;
+  }
+  return true;
+} // }}}
+
+void ib::IconManager::setMissing(const std::string &cache_key) { // {{{
+  missing_icons_[cache_key] = std::chrono::steady_clock::now() + std::chrono::seconds(MISSING_ICON_TTL);
+} // }}}
+
+// Rows of the same icon and size share one scaled image.
+ib::SharedIcon* ib::IconManager::acquireIcon(ib::IconCacheEntry *entry, const int width, const int height) { // {{{
+  ib::SharedIcon *shared = nullptr;
+  for(auto &s : entry->shared_icons_) {
+    if(s->w() == width && s->h() == height) {
+      shared = s;
+      break;
+    }
+  }
+  if(shared == nullptr) {
+    shared = new ib::SharedIcon(entry, entry->getIcon(), width, height);
+    entry->shared_icons_.push_back(shared);
+  }
+  shared->refs_++;
+  entry->refs_++;
+  return shared;
+} // }}}
+
+void ib::IconManager::releaseIcon(Fl_Image *icon) { // {{{
+  if(icon == nullptr) return;
+  auto shared = dynamic_cast<ib::SharedIcon*>(icon);
+  if(shared == nullptr) {
+    delete icon;
+    return;
+  }
+  ib::platform::ScopedLock lock(&cache_mutex_);
+  // shared icons are kept until the entry is evicted, so showing the
+  // icon again does not allocate a new image.
+  shared->refs_--;
+  shared->getEntry()->refs_--;
+} // }}}
 
 ib::IconManager::~IconManager() { // {{{
-  deleteCachedIcons();
-  loader_event_.stopThread();
+  loader_.stopThreads();
+  for(auto entry = lru_head_; entry != nullptr;) {
+    auto next = entry->next_;
+    delete entry;
+    entry = next;
+  }
   ib::platform::destroy_mutex(&cache_mutex_);
-  for(auto &pair : cached_icons_) { delete pair.second; }
 } // }}}
 
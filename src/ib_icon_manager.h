@@ -3,8 +3,8 @@
 
 #include "ib_constants.h"
 #include "ib_utils.h"
-#include "ib_event.h"
 #include "ib_platform.h"
+#include "ib_svg.h"
 #include "ib_singleton.h"
 
 static const unsigned char blank_png[] = { // {{{
@@ -4821,50 +4821,246 @@ const unsigned char iceberg_png[] = { // {{{
 }; // }}}
 
 namespace ib{
-  void _icon_loader(void *p);
+  ib::threadret _icon_loader_thread(void *p);
+
+  // Describes an icon to load. Requests do not refer to completion values,
+  // so the icon loader can load them without the listbox lock.
+  class IconRequest { // {{{
+    public:
+      enum Type { NONE, ASSOCIATED, IMAGE_FILE, LUA };
+      explicit IconRequest(const int size) : type_(NONE), path_(), size_(size) {}
+      Type getType() const { return type_; }
+      const std::string& getPath() const { return path_; }
+      int getSize() const { return size_; }
+      void setAssociatedIcon(const std::string &path) { type_ = ASSOCIATED; path_ = path; }
+      void setImgFileIcon(const std::string &path) { type_ = IMAGE_FILE; path_ = path; }
+      void setLuaIcon() { type_ = LUA; path_.clear(); }
+
+    protected:
+      Type type_;
+      std::string path_;
+      int size_;
+  }; // }}}
+
+  // Loads icons of the completion list on worker threads. Lines near the
+  // visible lines are loaded first, and lines far from them are not loaded
+  // until the list is scrolled to them.
+  class IconLoader : private NonCopyable<IconLoader> { // {{{
+    friend ib::threadret _icon_loader_thread(void *p);
+    public:
+      // lines within this number of pages from the visible lines are loaded in advance.
+      static const int PREFETCH_PAGES = 1;
+      // a maximum number of loaded icons that each worker can publish before they are drained.
+      static const std::size_t MAX_RESULTS = 64;
+
+      IconLoader() : workers_(), running_(0), operation_count_(-1), requests_(), queue_(), first_line_(1), last_line_(1), selected_line_(0), cmutex_(), is_drain_queued_(false) {}
+      ~IconLoader() { stopThreads(); }
+
+      void startThreads(const int count);
+      void stopThreads();
+      // replaces the lines to load. requests[i] is the icon of the line i+1.
+      void load(const int operation_count, std::vector<ib::IconRequest> &requests, const int first_line, const int last_line, const int selected_line);
+      void clear();
+      // reorders the lines to load when the list is scrolled or the selection is changed.
+      void setViewport(const int first_line, const int last_line, const int selected_line);
+      // sets loaded icons to the list. must be called on the main thread.
+      void drainResults();
+
+    protected:
+      class LoadedIcon { // {{{
+        public:
+          LoadedIcon() : operation_count(-1), line(0), icon(nullptr) {}
+          LoadedIcon(const int operation_count, const int line, Fl_Image *icon) : operation_count(operation_count), line(line), icon(icon) {}
+          int operation_count;
+          int line;
+          Fl_Image *icon;
+      }; // }}}
+
+      // each worker waits on its own condition, since notify_condition
+      // wakes only one waiter. Each worker is the only producer of its
+      // results, and the main thread is the only consumer.
+      class Worker : private NonCopyable<Worker> { // {{{
+        public:
+          explicit Worker(ib::IconLoader *loader) : loader(loader), thread(), cond(), results() {}
+          ib::IconLoader *loader;
+          ib::thread thread;
+          ib::condition cond;
+          ib::SpscQueue<LoadedIcon, MAX_RESULTS> results;
+      }; // }}}
+
+      void run(Worker *worker);
+      void notifyWorkers();
+      int getDistance(const int line) const;
+      bool comparePriority(const int a, const int b) const;
+      void publish(Worker *worker, const int operation_count, const int line, Fl_Image *icon);
+      void queueDrain();
+
+      std::vector<Worker*> workers_;
+      int running_;
+      int operation_count_;
+      std::vector<ib::IconRequest> requests_;
+      // lines to load. this is a heap whose top is the nearest line from the visible lines.
+      std::vector<int> queue_;
+      int first_line_;
+      int last_line_;
+      int selected_line_;
+      ib::cmutex cmutex_;
+      // true if drainResults has been queued by Fl::awake.
+      std::atomic<bool> is_drain_queued_;
+  }; // }}}
+
+  // An icon stored in the icon cache file. The pixels are not copied.
+  // Pixels are deflated if the size is smaller than width*height*depth.
+  class MappedIcon { // {{{
+    public:
+      MappedIcon() : data_(nullptr), size_(0), width_(0), height_(0), depth_(0) {}
+      MappedIcon(const unsigned char *data, const ib::u32 size, const int width, const int height, const int depth) : data_(data), size_(size), width_(width), height_(height), depth_(depth) {}
+      const unsigned char* getData() const { return data_; }
+      ib::u32 getSize() const { return size_; }
+      int getWidth() const { return width_; }
+      int getHeight() const { return height_; }
+      int getDepth() const { return depth_; }
+      bool isCompressed() const { return (std::size_t)size_ < (std::size_t)width_ * height_ * depth_; }
+
+    protected:
+      const unsigned char *data_;
+      ib::u32 size_;
+      int width_;
+      int height_;
+      int depth_;
+  }; // }}}
+
+  class IconCacheEntry;
+
+  // A cached icon scaled for display. Icons of the same entry and size are
+  // shared by reference counting, and the entry is not evicted while its
+  // icons are referenced. Shared icons must be released by
+  // IconManager::releaseIcon instead of delete.
+  class SharedIcon : public Fl_RGB_Image, private NonCopyable<SharedIcon> { // {{{
+    friend class IconManager;
+    public:
+      SharedIcon(ib::IconCacheEntry *entry, Fl_RGB_Image *image, const int width, const int height) : Fl_RGB_Image(image->array, image->data_w(), image->data_h(), image->d()), entry_(entry), refs_(0) {
+        alloc_array = false;
+        scale(width, height);
+      }
+      ib::IconCacheEntry* getEntry() const { return entry_; }
+      int getRefs() const { return refs_; }
+
+    protected:
+      ib::IconCacheEntry *entry_;
+      int refs_;
+  }; // }}}
+
+  // An entry of the icon cache. Entries are linked in the most recently
+  // used order, and own their icons and shared icons.
+  class IconCacheEntry : private NonCopyable<IconCacheEntry> { // {{{
+    friend class IconManager;
+    public:
+      IconCacheEntry(const std::string &key, Fl_RGB_Image *icon) : key_(key), icon_(icon), shared_icons_(), refs_(0), prev_(nullptr), next_(nullptr) {}
+      ~IconCacheEntry() {
+        for(auto &shared : shared_icons_) { delete shared; }
+        delete icon_;
+      }
+      const std::string& getKey() const { return key_; }
+      Fl_RGB_Image* getIcon() const { return icon_; }
+      std::size_t getBytes() const { return (std::size_t)icon_->data_w() * icon_->data_h() * icon_->d(); }
+      // true if any of the shared icons are referenced.
+      bool isPinned() const { return refs_ != 0; }
+
+    protected:
+      std::string key_;
+      Fl_RGB_Image *icon_;
+      std::vector<ib::SharedIcon*> shared_icons_;
+      int refs_;
+      IconCacheEntry *prev_;
+      IconCacheEntry *next_;
+  }; // }}}
 
   class IconManager : private NonCopyable<IconManager> {
     friend class ib::Singleton<ib::IconManager>;
     public:
-      IconManager() :loader_event_(0, _icon_loader), cache_mutex_(), cached_icons_(), cached_icons_reverse_(), cached_icons_queue_() {
+      IconManager() :loader_(), svg_cache_(), cache_mutex_(), cached_icons_(), lru_head_(nullptr), lru_tail_(nullptr), cached_bytes_(0), cache_hits_(0), cache_misses_(0), missing_icons_(), cache_file_(), mapped_icons_(), indexed_icons_(0), appended_icons_(0), needs_compaction_(false) {
         ib::platform::create_mutex(&cache_mutex_);
       }
       ~IconManager();
 
       void loadCompletionListIcons();
+      // loads icons into the cache on the given number of threads until
+      // the cache is full, and returns when they are loaded.
+      void preloadIcons(const std::vector<ib::IconRequest> &requests, const int threads);
       void dump();
       void load();
-      ib::CancelableEvent& getLoaderEvent() { return loader_event_; }
+      ib::IconLoader& getLoader() { return loader_; }
+      Fl_Image* loadIcon(const ib::IconRequest &request);
       Fl_Image* getAssociatedIcon(const char *path, const int size);
       Fl_Image* getEmptyIcon(const int width, const int height);
       Fl_Image* getLuaIcon(const int size);
       Fl_Image* getIcebergIcon(const int size);
       Fl_Image* getImgFileIcon(const char *file, const int size);
-      void deleteIcon(Fl_RGB_Image* icon);
+      // releases an icon returned by this class. Icons that are not shared are deleted.
+      void releaseIcon(Fl_Image *icon);
       void deleteCachedIcons();
       void shrinkCache();
+      // true if the cache has reached icon_cache_bytes or max_cached_icons.
+      bool isCacheFull();
+      void getCacheStats(unsigned long long &hits, unsigned long long &misses, std::size_t &bytes, std::size_t &icons);
 
     protected:
-      void createIconCache(const std::string &cache_key, Fl_RGB_Image *icon);
+      // seconds to remember icons that could not be loaded
+      static const int MISSING_ICON_TTL = 60;
+      static const char CACHE_MAGIC[];
+      static const ib::u32 CACHE_VERSION = 1;
+      static const std::size_t CACHE_HEADER_SIZE = 16;
+
+      void compactCacheFile(const std::string &path);
+      Fl_RGB_Image* decompressIcon(const ib::MappedIcon &mapped);
+
+      void linkEntry(ib::IconCacheEntry *entry);
+      void unlinkEntry(ib::IconCacheEntry *entry);
+      ib::IconCacheEntry* createIconCache(const std::string &cache_key, Fl_RGB_Image *icon);
       void deleteIconCache(const std::string &cache_key);
-      void deleteIconCache(Fl_RGB_Image *icon);
-      Fl_RGB_Image* getIconCache(const std::string &cache_key);
+      ib::IconCacheEntry* getIconCache(const std::string &cache_key);
+      ib::SharedIcon* findIcon(const std::string &cache_key, const int size);
+      ib::SharedIcon* publishIcon(const std::string &cache_key, Fl_RGB_Image *icon, const int size);
       bool isCached(const std::string &cache_key);
-      bool isCached(Fl_RGB_Image *icon);
-      Fl_RGB_Image* copyCache(Fl_RGB_Image* image, const int size);
-      Fl_RGB_Image* getEmbededIcon(const unsigned char *data, const char* cache_prefix, const int embsize, const int reqsize);
+      bool isMissing(const std::string &cache_key);
+      void setMissing(const std::string &cache_key);
+      ib::SharedIcon* acquireIcon(ib::IconCacheEntry *entry, const int width, const int height);
+      ib::SharedIcon* getEmbededIcon(const unsigned char *data, const char* cache_prefix, const int embsize, const int reqsize);
 
       Fl_Image* readPngFileIcon(const char *png_file, const int size);
       Fl_Image* readJpegFileIcon(const char *jpeg_file, const int size);
       Fl_Image* readGifFileIcon(const char *gif_file, const int size);
-      Fl_Image* readSvgFileIcon(const char *svg_file, const int size);
+      Fl_Image* readSvgFileIcon(const char *file, const char *svg_file, const int size);
       Fl_Image* readXpmFileIcon(const char *xpm_file, const int size);
 
-      ib::CancelableEvent loader_event_;
+      ib::IconLoader loader_;
+      ib::SvgCache svg_cache_;
+      // guards the members below. Images are never read or decoded with
+      // this lock held.
       ib::mutex cache_mutex_;
-      std::unordered_map<std::string, Fl_RGB_Image*> cached_icons_;
-      std::unordered_map<Fl_RGB_Image*, std::string> cached_icons_reverse_;
-      std::deque<std::string> cached_icons_queue_;
+      std::unordered_map<std::string, ib::IconCacheEntry*> cached_icons_;
+      // the most recently used entry
+      ib::IconCacheEntry *lru_head_;
+      // the least recently used entry
+      ib::IconCacheEntry *lru_tail_;
+      std::size_t cached_bytes_;
+      unsigned long long cache_hits_;
+      unsigned long long cache_misses_;
+      // cache key -> expiration time
+      std::unordered_map<std::string, std::chrono::steady_clock::time_point> missing_icons_;
+
+      // icons.cache is mapped into memory. Its layout is
+      //   header: magic, version, index offset, number of indexed icons
+      //   pixels of the indexed icons
+      //   index: (key, offset, width, height, depth, size) for each icon
+      //   append region: (key, width, height, depth, size, pixels) for each icon
+      // Icons created after the file is compacted are appended to the end.
+      ib::platform::MappedFile cache_file_;
+      std::unordered_map<std::string, ib::MappedIcon> mapped_icons_;
+      std::size_t indexed_icons_;
+      std::size_t appended_icons_;
+      bool needs_compaction_;
 
   };
 }
@@ -0,0 +1,360 @@
+#include "ib_image.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define IB_IMAGE_SSE2 1
+#  include <emmintrin.h>
+#endif
+// AVX2 kernels are selected at runtime, so that binaries still run on
+// CPUs that do not have AVX2.
+#if defined(IB_IMAGE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define IB_IMAGE_AVX2 1
+#  include <immintrin.h>
+#  define IB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Pixels are resized in the premultiplied alpha, so colors of transparent
+// pixels do not bleed into their neighbours. Rows are resized horizontally
+// first, and then the resized rows are averaged vertically.
+
+struct ResizeWeights { // {{{
+  // the first source pixel that each destination pixel covers.
+  std::vector<int> first;
+  // weights of the destination pixel i are weights[offset[i]..offset[i+1]).
+  std::vector<int> offset;
+  std::vector<float> weights;
+  // each weight repeated for the 4 channels of a pixel.
+  std::vector<float> pixel_weights;
+}; // }}}
+
+struct ResizeKernels { // {{{
+  void (*premultiply)(float *dst, const unsigned char *src, const int width);
+  void (*resize_row)(float *dst, const float *src, const int width, const ResizeWeights &weights);
+  void (*accumulate)(float *dst, const float *src, const float weight, const int count);
+  void (*unpremultiply)(unsigned char *dst, const float *src, const int width);
+}; // }}}
+
+static void compute_weights(ResizeWeights &result, const int src_n, const int dst_n) { // {{{
+  const double scale = (double)src_n / (double)dst_n;
+  result.first.resize(dst_n);
+  result.offset.resize(dst_n + 1);
+  result.weights.clear();
+  for(int i = 0; i < dst_n; ++i) {
+    const double begin = i * scale;
+    const double end = std::min<double>((i + 1) * scale, src_n);
+    const int first = (int)begin;
+    const int last = std::min<int>((int)std::ceil(end), src_n);
+    result.first[i] = first;
+    result.offset[i] = (int)result.weights.size();
+    for(int j = first; j < last; ++j) {
+      const double covered = std::min<double>(j + 1, end) - std::max<double>(j, begin);
+      result.weights.push_back((float)(covered / (end - begin)));
+    }
+  }
+  result.offset[dst_n] = (int)result.weights.size();
+  result.pixel_weights.resize(result.weights.size() * 4);
+  for(std::size_t i = 0; i < result.pixel_weights.size(); ++i) {
+    result.pixel_weights[i] = result.weights[i / 4];
+  }
+} // }}}
+
+static void expand_row(unsigned char *dst, const unsigned char *src, const int width, const int depth) { // {{{
+  for(int i = 0; i < width; ++i, src += depth, dst += 4) {
+    switch(depth) {
+      case 1:
+        dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255;
+        break;
+      case 2:
+        dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1];
+        break;
+      default:
+        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255;
+        break;
+    }
+  }
+} // }}}
+
+// scalar kernels {{{
+#ifndef IB_IMAGE_SSE2
+static inline unsigned char to_byte(float value) {
+  value += 0.5f;
+  if(value <= 0.0f) return 0;
+  if(value >= 255.0f) return 255;
+  return (unsigned char)value;
+}
+
+static void premultiply_scalar(float *dst, const unsigned char *src, const int width) {
+  for(int i = 0; i < width; ++i, src += 4, dst += 4) {
+    const float alpha = src[3] * (1.0f / 255.0f);
+    dst[0] = src[0] * alpha;
+    dst[1] = src[1] * alpha;
+    dst[2] = src[2] * alpha;
+    dst[3] = src[3];
+  }
+}
+
+static void resize_row_scalar(float *dst, const float *src, const int width, const ResizeWeights &weights) {
+  for(int i = 0; i < width; ++i, dst += 4) {
+    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+    const float *p = src + weights.first[i] * 4;
+    for(int j = weights.offset[i]; j < weights.offset[i+1]; ++j, p += 4) {
+      const float w = weights.weights[j];
+      r += p[0] * w; g += p[1] * w; b += p[2] * w; a += p[3] * w;
+    }
+    dst[0] = r; dst[1] = g; dst[2] = b; dst[3] = a;
+  }
+}
+
+static void accumulate_scalar(float *dst, const float *src, const float weight, const int count) {
+  for(int i = 0; i < count; ++i) {
+    dst[i] += src[i] * weight;
+  }
+}
+
+static void unpremultiply_scalar(unsigned char *dst, const float *src, const int width) {
+  for(int i = 0; i < width; ++i, src += 4, dst += 4) {
+    const float factor = src[3] > 0.0f ? 255.0f / src[3] : 0.0f;
+    dst[0] = to_byte(std::min<float>(src[0] * factor, 255.0f));
+    dst[1] = to_byte(std::min<float>(src[1] * factor, 255.0f));
+    dst[2] = to_byte(std::min<float>(src[2] * factor, 255.0f));
+    dst[3] = to_byte(src[3]);
+  }
+}
+#endif
+// }}}
+
+#ifdef IB_IMAGE_SSE2
+// SSE2 kernels {{{
+// a pixel is a __m128 of r, g, b and a.
+static inline __m128 premultiply_pixel_sse2(const __m128 pixel) {
+  const __m128 rgb_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  const __m128 alpha_one = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+  const __m128 alpha = _mm_mul_ps(_mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3)), _mm_set1_ps(1.0f / 255.0f));
+  return _mm_mul_ps(pixel, _mm_or_ps(_mm_and_ps(alpha, rgb_mask), alpha_one));
+}
+
+static inline __m128i unpremultiply_pixel_sse2(const __m128 pixel) {
+  const __m128 rgb_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  const __m128 alpha_one = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+  const __m128 alpha = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+  const __m128 visible = _mm_cmpgt_ps(alpha, _mm_setzero_ps());
+  const __m128 factor = _mm_and_ps(_mm_and_ps(_mm_div_ps(_mm_set1_ps(255.0f), alpha), visible), rgb_mask);
+  __m128 value = _mm_mul_ps(pixel, _mm_or_ps(factor, alpha_one));
+  value = _mm_add_ps(_mm_min_ps(value, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+  return _mm_cvttps_epi32(value);
+}
+
+static inline __m128 load_pixel_sse2(const unsigned char *src) {
+  int bytes;
+  memcpy(&bytes, src, 4);
+  const __m128i zero = _mm_setzero_si128();
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+}
+
+static inline void store_pixel_sse2(unsigned char *dst, __m128i pixel) {
+  pixel = _mm_packs_epi32(pixel, pixel);
+  pixel = _mm_packus_epi16(pixel, pixel);
+  const int bytes = _mm_cvtsi128_si32(pixel);
+  memcpy(dst, &bytes, 4);
+}
+
+static void premultiply_sse2(float *dst, const unsigned char *src, const int width) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for(; i + 4 <= width; i += 4, src += 16, dst += 16) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i*)src);
+    const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    _mm_storeu_ps(dst,      premultiply_pixel_sse2(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero))));
+    _mm_storeu_ps(dst + 4,  premultiply_pixel_sse2(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero))));
+    _mm_storeu_ps(dst + 8,  premultiply_pixel_sse2(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero))));
+    _mm_storeu_ps(dst + 12, premultiply_pixel_sse2(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero))));
+  }
+  for(; i < width; ++i, src += 4, dst += 4) {
+    _mm_storeu_ps(dst, premultiply_pixel_sse2(load_pixel_sse2(src)));
+  }
+}
+
+static void resize_row_sse2(float *dst, const float *src, const int width, const ResizeWeights &weights) {
+  const float *w = weights.pixel_weights.data();
+  for(int i = 0; i < width; ++i, dst += 4) {
+    __m128 sum = _mm_setzero_ps();
+    const float *p = src + weights.first[i] * 4;
+    for(int j = weights.offset[i]; j < weights.offset[i+1]; ++j, p += 4) {
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(p), _mm_loadu_ps(w + j * 4)));
+    }
+    _mm_storeu_ps(dst, sum);
+  }
+}
+
+static void accumulate_sse2(float *dst, const float *src, const float weight, const int count) {
+  const __m128 w = _mm_set1_ps(weight);
+  int i = 0;
+  for(; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+  }
+  for(; i < count; ++i) {
+    dst[i] += src[i] * weight;
+  }
+}
+
+static void unpremultiply_sse2(unsigned char *dst, const float *src, const int width) {
+  for(int i = 0; i < width; ++i, src += 4, dst += 4) {
+    store_pixel_sse2(dst, unpremultiply_pixel_sse2(_mm_loadu_ps(src)));
+  }
+}
+// }}}
+#endif
+
+#ifdef IB_IMAGE_AVX2
+// AVX2 kernels {{{
+// two pixels are processed at a time, one in each 128 bit lane. Remaining
+// pixels are processed in this function too, since calling SSE2 kernels
+// with the upper halves of the registers dirty is very slow.
+IB_TARGET_AVX2 static inline __m256 premultiply_pixels_avx2(const __m256 pixels) {
+  const __m256 rgb_mask = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+  const __m256 alpha_one = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  const __m256 alpha = _mm256_mul_ps(_mm256_shuffle_ps(pixels, pixels, _MM_SHUFFLE(3, 3, 3, 3)), _mm256_set1_ps(1.0f / 255.0f));
+  return _mm256_mul_ps(pixels, _mm256_or_ps(_mm256_and_ps(alpha, rgb_mask), alpha_one));
+}
+
+IB_TARGET_AVX2 static void premultiply_avx2(float *dst, const unsigned char *src, const int width) {
+  int i = 0;
+  for(; i + 4 <= width; i += 4, src += 16, dst += 16) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i*)src);
+    _mm256_storeu_ps(dst, premultiply_pixels_avx2(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes))));
+    _mm256_storeu_ps(dst + 8, premultiply_pixels_avx2(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)))));
+  }
+  for(; i < width; ++i, src += 4, dst += 4) {
+    _mm_storeu_ps(dst, premultiply_pixel_sse2(load_pixel_sse2(src)));
+  }
+}
+
+// source pixels are summed in pairs, and the two lanes are added at the end.
+IB_TARGET_AVX2 static void resize_row_avx2(float *dst, const float *src, const int width, const ResizeWeights &weights) {
+  const float *w = weights.pixel_weights.data();
+  for(int i = 0; i < width; ++i, dst += 4) {
+    __m256 sums = _mm256_setzero_ps();
+    const float *p = src + weights.first[i] * 4;
+    int j = weights.offset[i];
+    const int last = weights.offset[i+1];
+    for(; j + 2 <= last; j += 2, p += 8) {
+      sums = _mm256_add_ps(sums, _mm256_mul_ps(_mm256_loadu_ps(p), _mm256_loadu_ps(w + j * 4)));
+    }
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+    if(j < last) {
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(p), _mm_loadu_ps(w + j * 4)));
+    }
+    _mm_storeu_ps(dst, sum);
+  }
+}
+
+IB_TARGET_AVX2 static void accumulate_avx2(float *dst, const float *src, const float weight, const int count) {
+  const __m256 w = _mm256_set1_ps(weight);
+  int i = 0;
+  for(; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), w)));
+  }
+  for(; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), _mm256_castps256_ps128(w))));
+  }
+}
+
+IB_TARGET_AVX2 static void unpremultiply_avx2(unsigned char *dst, const float *src, const int width) {
+  const __m256 rgb_mask = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+  const __m256 alpha_one = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  int i = 0;
+  for(; i + 2 <= width; i += 2, src += 8, dst += 8) {
+    const __m256 pixels = _mm256_loadu_ps(src);
+    const __m256 alpha = _mm256_shuffle_ps(pixels, pixels, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256 visible = _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_GT_OQ);
+    const __m256 factor = _mm256_and_ps(_mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(255.0f), alpha), visible), rgb_mask);
+    __m256 value = _mm256_mul_ps(pixels, _mm256_or_ps(factor, alpha_one));
+    value = _mm256_add_ps(_mm256_min_ps(value, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f));
+    const __m256i values = _mm256_cvttps_epi32(value);
+    __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+    packed = _mm_packus_epi16(packed, packed);
+    _mm_storel_epi64((__m128i*)dst, packed);
+  }
+  for(; i < width; ++i, src += 4, dst += 4) {
+    store_pixel_sse2(dst, unpremultiply_pixel_sse2(_mm_loadu_ps(src)));
+  }
+}
+// }}}
+#endif
+
+static ResizeKernels select_kernels() { // {{{
+  ResizeKernels kernels;
+#if defined(IB_IMAGE_AVX2)
+  if(__builtin_cpu_supports("avx2")) {
+    kernels.premultiply = premultiply_avx2;
+    kernels.resize_row = resize_row_avx2;
+    kernels.accumulate = accumulate_avx2;
+    kernels.unpremultiply = unpremultiply_avx2;
+    return kernels;
+  }
+#endif
+#if defined(IB_IMAGE_SSE2)
+  kernels.premultiply = premultiply_sse2;
+  kernels.resize_row = resize_row_sse2;
+  kernels.accumulate = accumulate_sse2;
+  kernels.unpremultiply = unpremultiply_sse2;
+#else
+  kernels.premultiply = premultiply_scalar;
+  kernels.resize_row = resize_row_scalar;
+  kernels.accumulate = accumulate_scalar;
+  kernels.unpremultiply = unpremultiply_scalar;
+#endif
+  return kernels;
+} // }}}
+
+void ib::resize_image(unsigned char *dst, const int dst_w, const int dst_h, const unsigned char *src, const int src_w, const int src_h, const int depth, const int ld) { // {{{
+  if(dst_w <= 0 || dst_h <= 0 || src_w <= 0 || src_h <= 0) return;
+  static const ResizeKernels kernels = select_kernels();
+  const int stride = ld != 0 ? ld : src_w * depth;
+  const int dst_row_size = dst_w * 4;
+
+  ResizeWeights xweights, yweights;
+  compute_weights(xweights, src_w, dst_w);
+  compute_weights(yweights, src_h, dst_h);
+
+  std::vector<unsigned char> expanded(depth != 4 ? src_w * 4 : 0);
+  std::vector<float> row(src_w * 4);
+  std::vector<float> columns((std::size_t)src_h * dst_row_size);
+  for(int y = 0; y < src_h; ++y) {
+    const unsigned char *pixels = src + (std::size_t)y * stride;
+    if(depth != 4) {
+      expand_row(expanded.data(), pixels, src_w, depth);
+      pixels = expanded.data();
+    }
+    kernels.premultiply(row.data(), pixels, src_w);
+    kernels.resize_row(columns.data() + (std::size_t)y * dst_row_size, row.data(), dst_w, xweights);
+  }
+
+  std::vector<float> sum(dst_row_size);
+  for(int y = 0; y < dst_h; ++y) {
+    std::fill(sum.begin(), sum.end(), 0.0f);
+    const float *p = columns.data() + (std::size_t)yweights.first[y] * dst_row_size;
+    for(int j = yweights.offset[y]; j < yweights.offset[y+1]; ++j, p += dst_row_size) {
+      kernels.accumulate(sum.data(), p, yweights.weights[j], dst_row_size);
+    }
+    kernels.unpremultiply(dst + (std::size_t)y * dst_row_size, sum.data(), dst_w);
+  }
+} // }}}
+
+Fl_RGB_Image* ib::resize_icon(Fl_Image *image, const int size) { // {{{
+  std::unique_ptr<Fl_RGB_Image> converted;
+  auto rgb = dynamic_cast<Fl_RGB_Image*>(image);
+  if(rgb == nullptr) {
+    auto pixmap = dynamic_cast<Fl_Pixmap*>(image);
+    if(pixmap == nullptr) return nullptr;
+    converted.reset(new Fl_RGB_Image(pixmap));
+    rgb = converted.get();
+  }
+  if(rgb->count() < 1 || rgb->d() < 1 || rgb->d() > 4) return nullptr;
+
+  auto buf = new unsigned char[size * size * 4];
+  resize_image(buf, size, size, (const unsigned char*)rgb->data()[0], rgb->data_w(), rgb->data_h(), rgb->d(), rgb->ld());
+  auto result = new Fl_RGB_Image(buf, size, size, 4);
+  result->alloc_array = 1;
+  return result;
+} // }}}
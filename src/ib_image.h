@@ -0,0 +1,18 @@
+#ifndef __IB_IMAGE_H__
+#define __IB_IMAGE_H__
+
+#include "ib_constants.h"
+
+namespace ib{
+  // Resizes an image with 1-4 channels to a RGBA image. Each pixel of the
+  // result is an average of the area it covers, weighted by the alpha.
+  // `ld` is the number of bytes per row of the source, 0 means tightly packed.
+  void resize_image(unsigned char *dst, const int dst_w, const int dst_h, const unsigned char *src, const int src_w, const int src_h, const int depth, const int ld);
+
+  // Returns a new RGBA image that is `size` x `size` pixels, or nullptr if
+  // the image can not be converted. The given image is not deleted.
+  Fl_RGB_Image* resize_icon(Fl_Image *image, const int size);
+}
+
+
+#endif
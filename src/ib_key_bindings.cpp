@@ -0,0 +1,22 @@
+#include "ib_key_bindings.h"
+
+// class KeyBindings {{{
+void ib::KeyBindings::bind(const int *key_bind, const int action, const std::string &command) { // {{{
+  int len = 0;
+  for(;len < 3 && key_bind[len] != 0; ++len){}
+  if(len == 0) return;
+
+  int modifiers = 0;
+  for(int i = 0; i < len-1; ++i){
+    modifiers |= key_bind[i];
+  }
+  bindings_[toHashKey(key_bind[len-1], modifiers)] = ib::KeyBinding(action, command);
+} // }}}
+
+const ib::KeyBinding* ib::KeyBindings::find(const int key, const int state) const { // {{{
+  if(bindings_.empty()) return nullptr;
+  auto it = bindings_.find(toHashKey(key, state));
+  if(it == bindings_.end()) return nullptr;
+  return &((*it).second);
+} // }}}
+// }}}
@@ -0,0 +1,56 @@
+#ifndef __IB_KEY_BINDINGS_H__
+#define __IB_KEY_BINDINGS_H__
+
+#include "ib_constants.h"
+#include "ib_utils.h"
+
+namespace ib {
+
+  class KeyBinding { // {{{
+    public:
+      KeyBinding() : action_(0), command_("") {}
+      KeyBinding(const int action, const std::string &command) : action_(action), command_(command) {}
+      int getAction() const { return action_; }
+      const std::string& getCommand() const { return command_; }
+
+    protected:
+      int action_;
+      std::string command_;
+  }; // }}}
+
+  // A hash table from (key, modifiers) to an action.
+  // A lookup is equivalent to testing every binding with ib::utils::matches_key.
+  class KeyBindings : private NonCopyable<KeyBindings> { // {{{
+    public:
+      enum Action {
+        NONE = 0,
+        HOT_KEY,
+        ESCAPE,
+        LIST_NEXT,
+        LIST_PREV,
+        TOGGLE_MODE,
+        KILL_WORD,
+        SHORTCUT
+      };
+
+      KeyBindings() : bindings_() {}
+      void clear() { bindings_.clear(); }
+      bool empty() const { return bindings_.empty(); }
+      void bind(const int *key_bind, const int action, const std::string &command = "");
+      const ib::KeyBinding* find(const int key, const int state) const;
+      int findAction(const int key, const int state) const {
+        const auto binding = find(key, state);
+        return binding == nullptr ? NONE : binding->getAction();
+      }
+
+    protected:
+      static unsigned long long toHashKey(const int key, const int modifiers) {
+        return (static_cast<unsigned long long>(static_cast<unsigned int>(modifiers)) << 32) | static_cast<unsigned int>(key);
+      }
+
+      std::unordered_map<unsigned long long, ib::KeyBinding> bindings_;
+  }; // }}}
+
+}
+
+#endif
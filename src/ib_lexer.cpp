@@ -19,33 +19,144 @@ void ib::Lexer::parse(const char *input) { // {{{
   input_ = input;
 
   onBeforeLoop();
+  readLoop();
+  onAfterLoop();
+} // }}}
+
+void ib::Lexer::readLoop() { // {{{
   do {
     // read an utf8 character
-    c_ = input[ptr_];
+    c_ = input_[ptr_];
     if(c_ == '\0') break;
     utf8_len_ = ib::utils::utf8len(c_);
     onReadChar();
     ppc_ = pc_;
     pc_ = c_;
   }while(1);
-  onAfterLoop();
 } // }}}
 // }}}
 
 // class CommandLexer {{{
 void ib::CommandLexer::clear() { // {{{
   Lexer::clear();
-  token_ = 0;
-  strbuf_.clear();
-  for (auto it = tokens_.begin(), last = tokens_.end(); it != last; ++it ) {
-    if(!(*it)->isNullToken()) delete *it;
-  }
+  text_.clear();
+  unescaped_.clear();
+  arena_.clear();
   tokens_.clear();
-  ib::utils::delete_pointer_vectors(param_values_);
+  param_values_buf_.clear();
   param_values_.clear();
+  param_values_dirty_ = true;
+  token_start_ = 0;
+  token_type_ = Token::VALUE;
+  token_escaped_ = false;
   is_using_cwd_ = false;
 } // }}}
 
+void ib::CommandLexer::parse(const char *input) { // {{{
+  clear();
+  update(input);
+} // }}}
+
+void ib::CommandLexer::update(const char *input) { // {{{
+  if(input == nullptr) input = "";
+
+  // find the first changed character
+  std::size_t pos = 0;
+  const auto length = text_.size();
+  while(pos < length && text_[pos] == input[pos]) ++pos;
+  if(pos == length && input[pos] == '\0') return;
+
+  // tokens that end before the changed character can not be affected
+  // by the edit, so the lexer restarts from the end of the last one.
+  std::size_t ntokens = 0;
+  while(ntokens < arena_.size() && arena_[ntokens].getEndPos() < pos) ++ntokens;
+
+  if(ntokens == 0){
+    clear();
+    text_.assign(input);
+  }else{
+    truncate(ntokens);
+    text_.resize(pos);
+    text_.append(input + pos);
+  }
+  if(text_.empty()) return;
+
+  Lexer::clear();
+  input_ = text_.c_str();
+  ptr_ = ntokens == 0 ? 0 : arena_.back().getEndPos();
+
+  onBeforeLoop();
+  readLoop();
+  onAfterLoop();
+} // }}}
+
+void ib::CommandLexer::truncate(const std::size_t ntokens) { // {{{
+  for(auto i = ntokens; i < arena_.size(); ++i){
+    if(arena_[i].isEscaped()){
+      unescaped_.resize(arena_[i].getValuePos());
+      break;
+    }
+  }
+  arena_.erase(arena_.begin() + ntokens, arena_.end());
+  tokens_.resize(ntokens);
+  param_values_dirty_ = true;
+} // }}}
+
+void ib::CommandLexer::pushToken(const std::size_t end_pos) { // {{{
+  Token token(token_type_, token_start_);
+  const auto token_end = std::min(end_pos, text_.size());
+  token.setToken(&text_, token_end);
+
+  auto value_start = token_start_;
+  auto value_end = token_end;
+  if(token_type_ == Token::STRING) {
+    value_start++;
+    value_end--;
+  }else if(token_type_ == Token::UNTERM_STRING) {
+    value_start++;
+  }
+
+  if(token_escaped_){
+    // escaped double quotes are the only case where a value is not
+    // a part of the input.
+    const auto pos = unescaped_.size();
+    for(auto i = value_start; i < value_end; ++i){
+      if(text_[i] == '\\' && i+1 < value_end && text_[i+1] == '"') continue;
+      unescaped_ += text_[i];
+    }
+    token.setValue(&unescaped_, pos, unescaped_.size() - pos);
+  }else{
+    token.setValue(&text_, value_start, value_end - value_start);
+  }
+
+  const auto data = arena_.data();
+  arena_.push_back(token);
+  if(arena_.data() != data) {
+    tokens_.clear();
+    for(auto &t : arena_) { tokens_.push_back(&t); }
+  }else{
+    tokens_.push_back(&arena_.back());
+  }
+  param_values_dirty_ = true;
+} // }}}
+
+const std::vector<std::string*>& ib::CommandLexer::getParamValues() const { // {{{
+  if(param_values_dirty_){
+    param_values_.clear();
+    param_values_buf_.clear();
+    for(std::size_t i = 1; i < tokens_.size(); ++i){
+      if(tokens_[i]->isValueToken()) {
+        param_values_buf_.push_back(tokens_[i]->getValue().str());
+      }
+    }
+    for(auto &value : param_values_buf_) {
+      param_values_.push_back(&value);
+    }
+    param_values_dirty_ = false;
+  }
+  return param_values_;
+} // }}}
+
 void ib::CommandLexer::onReadChar() { // {{{
   if(ptr_ == 0 && c_ == '!'){
     is_using_cwd_ = true;
@@ -56,16 +167,16 @@ void ib::CommandLexer::onReadChar() { // {{{
   switch(state_){
     //initial state
     case 0:
-      strbuf_.clear();
-      strbuf_.append(input_+ptr_, utf8_len_);
+      token_start_ = ptr_;
+      token_escaped_ = false;
       if(c_ == '"' && pc_ != '\\'){
-        token_ = new UntermStringToken(ptr_);
+        token_type_ = Token::UNTERM_STRING;
         state_ = 1; /* read string */
       }else if(isspace(c_)) {
-        token_ = new DelimiterToken(ptr_);
+        token_type_ = Token::DELIMITER;
         state_ = 2; /* read delim */
       }else{
-        token_ = new ValueToken(ptr_);
+        token_type_ = Token::VALUE;
         state_ = 3; /* read value */
       }
       ptr_ += utf8_len_;
@@ -75,46 +186,35 @@ void ib::CommandLexer::onReadChar() { // {{{
       if(c_ == '"'){
         // double quote
         if(pc_ != '\\') {
-          auto saved_start_pos = token_->getStartPos();
-          delete token_;
-          token_ = new StringToken(saved_start_pos);
-          strbuf_.append(input_+ptr_, utf8_len_);
-          token_->setToken(strbuf_);
-          tokens_.push_back(token_);
-
+          token_type_ = Token::STRING;
           ptr_++;
+          pushToken(ptr_);
           state_ = 0;
         // escaped double quote
         }else{
-          strbuf_ = strbuf_.substr(0, strbuf_.length()-1);
-          strbuf_.append(input_+ptr_, utf8_len_);
+          token_escaped_ = true;
           ptr_ += utf8_len_;
         }
       // others
       }else{
-        strbuf_.append(input_+ptr_, utf8_len_);
         ptr_ += utf8_len_;
       }
       break;
     // read delim
     case 2:
       if(!isspace(c_)) {
-        token_->setToken(strbuf_);
-        tokens_.push_back(token_);
+        pushToken(ptr_);
         state_ = 0;
       }else{
-        strbuf_.append(input_+ptr_, utf8_len_);
         ptr_ += utf8_len_;
       }
       break;
     // read value
     case 3:
       if(isspace(c_) || (c_ == '"' && pc_ != '\\')){
-        token_->setToken(strbuf_);
-        tokens_.push_back(token_);
+        pushToken(ptr_);
         state_ = 0;
       }else{
-        strbuf_.append(input_+ptr_, utf8_len_);
         ptr_ += utf8_len_;
       }
       break;
@@ -125,19 +225,9 @@ void ib::CommandLexer::onReadChar() { // {{{
 } // }}}
 
 void ib::CommandLexer::onAfterLoop() { // {{{
-  if(state_ != 0 && token_ != nullptr){
-    token_->setToken(strbuf_);
-    tokens_.push_back(token_);
-  }
-
-  if(tokens_.size() > 1){
-    for(auto params_it = std::next(tokens_.begin()), last = tokens_.end(); params_it != last; ++params_it){
-      if((*params_it)->isValueToken()) {
-        param_values_.push_back(new std::string((*params_it)->getValue().c_str()));
-      }
-    }
+  if(state_ != 0){
+    pushToken(ptr_);
   }
-
 } // }}}
 // }}}
 
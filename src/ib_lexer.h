@@ -8,70 +8,60 @@
 namespace ib {
 
   // Tokens {{{
-  class Token : private NonCopyable<Token> { // {{{
+  // Tokens do not own their text. They refer to the input buffer of
+  // the lexer that created them and are valid until the next parse.
+  class Token { // {{{
     public:
-      Token(const std::size_t start_pos) : start_pos_(start_pos), end_pos_(0), token_(""), value_("") { }
-      virtual ~Token() {}
-      virtual bool isNullToken() const { return false; }
-      virtual bool isValueToken() const { return true; }
+      enum Type {
+        VALUE = 0,
+        DELIMITER,
+        STRING,
+        UNTERM_STRING,
+        NULL_TOKEN
+      };
+
+      Token(const Type type, const std::size_t start_pos) : type_(type), start_pos_(start_pos), end_pos_(start_pos), text_(nullptr), value_buf_(nullptr), value_pos_(0), value_length_(0) { }
+      Type getType() const { return type_; }
+      bool isNullToken() const { return type_ == NULL_TOKEN; }
+      bool isValueToken() const { return type_ != DELIMITER && type_ != NULL_TOKEN; }
       std::size_t getStartPos() const { return start_pos_; }
-      std::size_t getLength() const { return length_; }
+      std::size_t getLength() const { return end_pos_ - start_pos_; }
       std::size_t getEndPos() const { return end_pos_; }
-      const std::string& getToken() const { return token_; }
-      virtual void setToken(const std::string &token) {
-        token_ = token;
-        value_ = token;
-        end_pos_ = start_pos_ + token.length();
-        length_ = end_pos_ - start_pos_;
+      bool isEscaped() const { return value_buf_ != nullptr && value_buf_ != text_; }
+      std::size_t getValuePos() const { return value_pos_; }
+      ib::StringView getToken() const {
+        if(text_ == nullptr) return ib::StringView();
+        return ib::StringView(text_->data() + start_pos_, end_pos_ - start_pos_);
+      }
+      ib::StringView getValue() const {
+        if(value_buf_ == nullptr) return ib::StringView();
+        return ib::StringView(value_buf_->data() + value_pos_, value_length_);
+      }
+      void setToken(const std::string *text, const std::size_t end_pos) {
+        text_ = text;
+        end_pos_ = end_pos;
+      }
+      void setValue(const std::string *buf, const std::size_t pos, const std::size_t length) {
+        value_buf_ = buf;
+        value_pos_ = pos;
+        value_length_ = length;
       }
-      const std::string& getValue() const { return value_; }
     
     protected:
-      std::size_t start_pos_;
-      std::size_t end_pos_;
-      std::size_t length_;
-      std::string  token_;
-      std::string  value_;
-
-
-  }; // }}}
+      Type         type_;
+      std::size_t  start_pos_;
+      std::size_t  end_pos_;
+      const std::string *text_;
+      const std::string *value_buf_;
+      std::size_t  value_pos_;
+      std::size_t  value_length_;
 
-  class ValueToken : public Token { // {{{
-    public:
-      ValueToken(const std::size_t start_pos) : Token(start_pos) {}
-  }; // }}}
-
-  class DelimiterToken : public Token { // {{{
-    public:
-      DelimiterToken(const std::size_t start_pos) : Token(start_pos) {}
-      bool isValueToken() const { return false; }
   }; // }}}
 
   class NullToken : public Token, private NonCopyable<NullToken> { // {{{
     friend class ib::Singleton<NullToken>;
-    public:
-      bool isNullToken() const { return true; }
-      bool isValueToken() const { return false; }
     protected:
-      NullToken() : Token(0) {}
-  }; // }}}
-
-  class StringToken : public Token { // {{{
-    public:
-      StringToken(const std::size_t start_pos) : Token(start_pos) {}
-      void setToken(const std::string &token) {
-        Token::setToken(token);
-        value_ = token_.substr(1, token_.length()-2);
-      }
-  }; // }}}
-
-  class UntermStringToken : public Token { // {{{
-    public:
-      UntermStringToken(const std::size_t start_pos) : Token(start_pos) {}
-      void setToken(const std::string &token) {
-        Token::setToken(token);
-        value_ = token_.substr(1);
-      }
+      NullToken() : Token(Token::NULL_TOKEN, 0) {}
   }; // }}}
 
   // }}}
@@ -88,6 +78,8 @@ namespace ib {
       virtual void onAfterLoop() = 0;
 
     protected:
+      void readLoop();
+
       unsigned char state_;
       unsigned char c_;
       unsigned char pc_;
@@ -99,23 +91,36 @@ namespace ib {
 
   class CommandLexer : public Lexer { // {{{
     public:
-      CommandLexer() : Lexer(), tokens_(), param_values_(), strbuf_(""), token_(nullptr), is_using_cwd_(false) {}
+      CommandLexer() : Lexer(), text_(), unescaped_(), arena_(), tokens_(), param_values_buf_(), param_values_(), param_values_dirty_(true), token_start_(0), token_type_(Token::VALUE), token_escaped_(false), is_using_cwd_(false) {}
       ~CommandLexer() { clear(); }
 
       void clear();
+      void parse(const char *input);
+      void parse(const std::string &input) { return parse(input.c_str()); }
+      // re-lexes the input from the first changed character.
+      void update(const char *input);
       void onReadChar();
       void onAfterLoop();
 
       const std::vector<Token*>& getTokens() const { return tokens_;}
-      const std::vector<std::string*>& getParamValues() const { return param_values_;}
-      const std::string& getFirstValue() const { return tokens_.at(0)->getValue(); }
+      const std::vector<std::string*>& getParamValues() const;
+      ib::StringView getFirstValue() const { return tokens_.at(0)->getValue(); }
       bool isUsingCwd() const { return is_using_cwd_; }
 
     protected:
+      void pushToken(const std::size_t end_pos);
+      void truncate(const std::size_t ntokens);
+
+      std::string text_;
+      std::string unescaped_;
+      std::vector<Token> arena_;
       std::vector<Token*> tokens_;
-      std::vector<std::string*> param_values_;
-      std::string strbuf_;
-      Token *token_;
+      mutable std::vector<std::string> param_values_buf_;
+      mutable std::vector<std::string*> param_values_;
+      mutable bool param_values_dirty_;
+      std::size_t token_start_;
+      Token::Type token_type_;
+      bool token_escaped_;
       bool is_using_cwd_;
   }; // }}}
 
@@ -5,6 +5,8 @@
 #include "ib_controller.h"
 #include "ib_regex.h"
 #include "ib_config.h"
+#include "ib_completer.h"
+#include "ib_icon_manager.h"
 #include "ib_singleton.h"
 
 // Lua Class "Regex" {{{
@@ -33,7 +35,8 @@ static ib::Regex* push_regex (lua_State *L, ib::Regex *value) {
 static int Regex_new (lua_State *L) {
   const auto pattern = luaL_checkstring(L, 1);
   const auto flags = static_cast<unsigned int>(luaL_checkint(L, 2));
-  auto value = new ib::Regex(pattern, flags);
+  const auto is_cached = lua_isnoneornil(L, 3) || lua_toboolean(L, 3) != 0;
+  auto value = new ib::Regex(pattern, flags, is_cached);
   std::unique_ptr<std::string> msg(new std::string());
   if(value->init(msg.get()) != 0) {
     return luaL_error(L, "Invalid regular expression: %s", msg.get()->c_str());
@@ -459,11 +462,14 @@ int ib::luamodule::create(lua_State *L){ // {{{
   REGISTER_FUNCTION(shell_execute);
   REGISTER_FUNCTION(command_execute);
   REGISTER_FUNCTION(command_output);
+  REGISTER_FUNCTION(command_output_async);
   REGISTER_FUNCTION(default_after_command_action);
   REGISTER_FUNCTION(add_history);
+  REGISTER_FUNCTION(invalidate_completion);
   REGISTER_FUNCTION(open_dir);
   REGISTER_FUNCTION(version);
   REGISTER_FUNCTION(selected_index);
+  REGISTER_FUNCTION(icon_cache_stats);
   REGISTER_FUNCTION(utf82local);
   REGISTER_FUNCTION(local2utf8);
 #ifdef IB_OS_WIN
@@ -733,7 +739,8 @@ int ib::luamodule::get_input_text_values(lua_State *L) { // {{{
     token = lexer.getTokens().at(i);
     if(token->isValueToken()) {
       lua_pushnumber(L, index++);
-      lua_pushstring(L, token->getValue().c_str());
+      const auto value = token->getValue();
+      lua_pushlstring(L, value.data(), value.size());
       lua_settable(L, -3);
     }
   }
@@ -859,24 +866,111 @@ int ib::luamodule::command_execute(lua_State *L) { // {{{
   return 2;
 } // }}}
 
+static void read_command_output_options(lua_State *L, const int index, int &timeout, std::size_t &max_size) { // {{{
+  timeout = 0;
+  max_size = 0;
+  if(!lua_istable(L, index)) return;
+  lua_getfield(L, index, "timeout");
+  if(lua_isnumber(L, -1)) timeout = static_cast<int>(lua_tonumber(L, -1) * 1000);
+  lua_pop(L, 1);
+  lua_getfield(L, index, "max_size");
+  if(lua_isnumber(L, -1)) max_size = static_cast<std::size_t>(lua_tointeger(L, -1));
+  lua_pop(L, 1);
+} // }}}
+
 int ib::luamodule::command_output(lua_State *L) { // {{{
   ib::LuaState lua_state(L);
-  const auto cmd = luaL_checkstring(L, 1);
+  const auto cmd = std::string(luaL_checkstring(L, 1));
+  int timeout;
+  std::size_t max_size;
+  read_command_output_options(L, 2, timeout, max_size);
   std::string sstdout, sstderr;
   ib::Error error;
 
   lua_state.clearStack();
-  if(ib::platform::command_output(sstdout, sstderr, cmd, error) != 0){
+  if(ib::platform::command_output(sstdout, sstderr, cmd.c_str(), timeout, max_size, error) != 0){
     lua_pushboolean(L, false);
   }else{
     lua_pushboolean(L, true);
   }
 
-  lua_pushstring(L, sstdout.c_str());
-  lua_pushstring(L, sstderr.c_str());
+  lua_pushlstring(L, sstdout.data(), sstdout.size());
+  lua_pushlstring(L, sstderr.data(), sstderr.size());
   return 3;
 } // }}}
 
+// class LuaCommandOutputListener {{{
+// Calls a Lua function for each line of the outputs.
+class LuaCommandOutputListener : public ib::platform::CommandOutputListener { // {{{
+  public:
+    explicit LuaCommandOutputListener(const int ref) : ref_(ref), stdout_buf_(), stderr_buf_() {}
+    ~LuaCommandOutputListener() { luaL_unref(IB_LUA, LUA_REGISTRYINDEX, ref_); }
+
+    void onStdout(const char *data, const std::size_t size) { emitLines("stdout", stdout_buf_, data, size); }
+    void onStderr(const char *data, const std::size_t size) { emitLines("stderr", stderr_buf_, data, size); }
+    void onExit(const int code, const ib::Error &error) {
+      if(!stdout_buf_.empty()) call("stdout", stdout_buf_.data(), stdout_buf_.size());
+      if(!stderr_buf_.empty()) call("stderr", stderr_buf_.data(), stderr_buf_.size());
+      lua_rawgeti(IB_LUA, LUA_REGISTRYINDEX, ref_);
+      lua_pushstring(IB_LUA, "exit");
+      lua_pushinteger(IB_LUA, code);
+      lua_pushstring(IB_LUA, error.getMessage().c_str());
+      if(lua_pcall(IB_LUA, 3, 0, 0) != 0) {
+        ib::utils::message_box("%s", lua_tostring(IB_LUA, -1));
+        lua_pop(IB_LUA, 1);
+      }
+    }
+
+  protected:
+    void emitLines(const char *name, std::string &buf, const char *data, const std::size_t size) {
+      buf.append(data, size);
+      std::size_t start = 0;
+      for(std::size_t pos; (pos = buf.find('\n', start)) != std::string::npos; start = pos + 1) {
+        auto end = pos;
+        if(end > start && buf[end-1] == '\r') end--;
+        call(name, buf.data() + start, end - start);
+      }
+      buf.erase(0, start);
+    }
+
+    void call(const char *name, const char *line, const std::size_t size) {
+      lua_rawgeti(IB_LUA, LUA_REGISTRYINDEX, ref_);
+      lua_pushstring(IB_LUA, name);
+      lua_pushlstring(IB_LUA, line, size);
+      if(lua_pcall(IB_LUA, 2, 0, 0) != 0) {
+        ib::utils::message_box("%s", lua_tostring(IB_LUA, -1));
+        lua_pop(IB_LUA, 1);
+      }
+    }
+
+    int ref_;
+    std::string stdout_buf_;
+    std::string stderr_buf_;
+}; // }}}
+// }}}
+
+int ib::luamodule::command_output_async(lua_State *L) { // {{{
+  ib::LuaState lua_state(L);
+  const auto cmd = std::string(luaL_checkstring(L, 1));
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  int timeout;
+  std::size_t max_size;
+  read_command_output_options(L, 3, timeout, max_size);
+  lua_pushvalue(L, 2);
+  const auto ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_state.clearStack();
+
+  ib::Error error;
+  if(ib::platform::command_output_async(cmd.c_str(), new LuaCommandOutputListener(ref), timeout, max_size, error) != 0){
+    lua_pushboolean(L, false);
+    lua_pushstring(L, error.getMessage().c_str());
+  }else{
+    lua_pushboolean(L, true);
+    lua_pushstring(L, "");
+  }
+  return 2;
+} // }}}
+
 int ib::luamodule::default_after_command_action(lua_State *L) { // {{{
   ib::LuaState lua_state(L);
   luaL_checktype(L, 1, LUA_TBOOLEAN);
@@ -909,6 +1003,18 @@ int ib::luamodule::add_history(lua_State *L) { // {{{
   return 0;
 } // }}}
 
+int ib::luamodule::invalidate_completion(lua_State *L) { // {{{
+  ib::LuaState lua_state(L);
+  auto completer = ib::Singleton<ib::Completer>::getInstance();
+  if(lua_gettop(L) > 0 && !lua_isnil(L, 1)) {
+    completer->invalidateOptionCache(std::string(luaL_checkstring(L, 1)));
+  }else{
+    completer->invalidateOptionCache();
+  }
+  lua_state.clearStack();
+  return 0;
+} // }}}
+
 int ib::luamodule::open_dir(lua_State *L) { // {{{
   ib::LuaState lua_state(L);
   const auto path = luaL_checkstring(L, 1);
@@ -938,6 +1044,22 @@ int ib::luamodule::selected_index(lua_State *L) { // {{{
   return 1;
 } // }}}
 
+int ib::luamodule::icon_cache_stats(lua_State *L) { // {{{
+  unsigned long long hits, misses;
+  std::size_t bytes, icons;
+  ib::Singleton<ib::IconManager>::getInstance()->getCacheStats(hits, misses, bytes, icons);
+  lua_newtable(L);
+  lua_pushnumber(L, (lua_Number)hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushnumber(L, (lua_Number)misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushnumber(L, (lua_Number)bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushnumber(L, (lua_Number)icons);
+  lua_setfield(L, -2, "icons");
+  return 1;
+} // }}}
+
 int ib::luamodule::utf82local(lua_State *L) { // {{{
   ib::LuaState lua_state(L);
   const auto text = luaL_checkstring(L, 1);
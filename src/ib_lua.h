@@ -65,12 +65,15 @@ namespace ib {
     int get_clipboard_histories(lua_State *L); // void -> clipboard_histories:list
     int shell_execute(lua_State *L); // path:string, args:[string], workdir:string -> bool:success, string:message
     int command_execute(lua_State *L); // name:string, args:[string] -> bool:success, string:message
-    int command_output(lua_State *L); // command:string -> bool:success, string:stdout, string:stderr
+    int command_output(lua_State *L); // command:string [, options:table] -> bool:success, string:stdout, string:stderr
+    int command_output_async(lua_State *L); // command:string, callback:function [, options:table] -> bool:success, string:message
     int default_after_command_action(lua_State *L); // success:bool, errmessage:text -> void
     int add_history(lua_State *L); //  input:string [, name:string] -> void
+    int invalidate_completion(lua_State *L); // [name:string] -> void
     int open_dir(lua_State *L); // path:string -> bool:success, text:errmessage
     int version(lua_State *L); // void -> string
     int selected_index(lua_State *L); // void -> int(start from 1)
+    int icon_cache_stats(lua_State *L); // void -> {hits:int, misses:int, bytes:int, icons:int}
     int utf82local(lua_State *L); // string -> string
     int local2utf8(lua_State *L); // string -> string
 #ifdef IB_OS_WIN
@@ -15,6 +15,35 @@
 
 namespace ib {
   namespace platform {
+    // Receives outputs of command_output_async on the main thread.
+    class CommandOutputListener : private NonCopyable<CommandOutputListener> { // {{{
+      public:
+        CommandOutputListener() {}
+        virtual ~CommandOutputListener() {}
+        virtual void onStdout(const char *data, const std::size_t size) = 0;
+        virtual void onStderr(const char *data, const std::size_t size) = 0;
+        // code is an exit code of the command, or -1 if the command was
+        // killed or failed.
+        virtual void onExit(const int code, const ib::Error &error) = 0;
+    }; // }}}
+
+    // A read-only memory mapped file.
+    class MappedFile : private NonCopyable<MappedFile> { // {{{
+      public:
+        MappedFile() : data_(nullptr), size_(0), handle_(nullptr) {}
+        ~MappedFile() { close(); }
+        int open(const ib::oschar *path, ib::Error &error);
+        void close();
+        const char* getData() const { return data_; }
+        std::size_t getSize() const { return size_; }
+
+      protected:
+        const char *data_;
+        std::size_t size_;
+        // platform specific handle
+        void *handle_;
+    }; // }}}
+
     int  startup_system();
     int  init_system();
     void finalize_system();
@@ -39,6 +68,10 @@ namespace ib {
     int  shell_execute(const std::string &path, const std::vector<std::unique_ptr<std::string>> &params, const std::string &cwd, const std::string &terminal, bool sudo, ib::Error& error);
     int  shell_execute(const std::string &path, const std::vector<std::string*> &params, const std::string &cwd, const std::string &terminal, bool sudo, ib::Error& error);
     int command_output(std::string &sstdout, std::string &sstderr, const char *command, ib::Error &error);
+    // timeout(ms) and max_size(bytes of stdout and stderr) are unlimited if 0.
+    int command_output(std::string &sstdout, std::string &sstderr, const char *command, const int timeout, const std::size_t max_size, ib::Error &error);
+    // takes ownership of the listener.
+    int command_output_async(const char *command, ib::platform::CommandOutputListener *listener, const int timeout, const std::size_t max_size, ib::Error &error);
     int show_context_menu(ib::oschar *path);
     void on_command_init(ib::Command *command);
     ib::oschar* default_config_path(ib::oschar *result);
@@ -70,6 +103,10 @@ namespace ib {
     int remove_file(const ib::oschar *path, ib::Error &error);
     int copy_file(const ib::oschar *source, const ib::oschar *dest, ib::Error &error);
     int file_size(size_t &size, const ib::oschar *path, ib::Error &error);
+    // replaces dest if it exists.
+    int rename_file(const ib::oschar *source, const ib::oschar *dest, ib::Error &error);
+    // flushes the stream and writes the data to the disk.
+    int sync_file(std::FILE *fp, ib::Error &error);
     ib::oschar* file_type(ib::oschar *result, const ib::oschar *path);
 
     /* thread functions */
@@ -17,6 +17,9 @@ static char ib_g_lang[32];
 static int  ib_g_hotkey;
 static const int XERROR_MSG_SIZE = 1024;
 static char ib_g_xerror_msg[XERROR_MSG_SIZE];
+// limits for helper commands such as xdg-mime and ldd
+static const int HELPER_COMMAND_TIMEOUT = 3000;
+static const std::size_t HELPER_COMMAND_MAX_SIZE = 1024*1024;
 class TrayIcon;
 typedef struct atoms_ {
   Atom xembed_info;
@@ -126,7 +129,7 @@ static bool xdg_mime_filetype(std::string &result, const char *path, ib::Error &
   std::string out, err;
   char quoted[IB_MAX_PATH];
   ib::platform::quote_string(quoted, path);
-  if(ib::platform::command_output(out, err, ("xdg-mime query filetype " + std::string(quoted)).c_str(), e) == 0) {
+  if(ib::platform::command_output(out, err, ("xdg-mime query filetype " + std::string(quoted)).c_str(), HELPER_COMMAND_TIMEOUT, HELPER_COMMAND_MAX_SIZE, e) == 0) {
     ib::Regex re("([^;]+)(;.*)?", ib::Regex::NONE);
     re.init();
     if(re.match(out) == 0) {
@@ -141,7 +144,7 @@ static bool xdg_mime_filetype(std::string &result, const char *path, ib::Error &
 
 static bool xdg_mime_default_app(std::string &result, const char *mime, ib::Error &e) {
   std::string out, err;
-  if(ib::platform::command_output(out, err, ("xdg-mime query default " + std::string(mime)).c_str(), e) == 0) {
+  if(ib::platform::command_output(out, err, ("xdg-mime query default " + std::string(mime)).c_str(), HELPER_COMMAND_TIMEOUT, HELPER_COMMAND_MAX_SIZE, e) == 0) {
     result = out;
     return true;
   }
@@ -232,21 +235,67 @@ class FreeDesktopKVFile : private ib::NonCopyable<FreeDesktopKVFile> { // {{{
     std::map<std::tuple<std::string, std::string>, std::string> map_;
 }; // }}}
 
+class FreeDesktopMimeGlob { // {{{
+  public:
+    FreeDesktopMimeGlob(const int weight, const std::size_t type, const std::string &pattern, const bool case_sensitive) : weight_(weight), type_(type), pattern_(pattern), case_sensitive_(case_sensitive) {}
+    int getWeight() const { return weight_; }
+    std::size_t getType() const { return type_; }
+    const std::string& getPattern() const { return pattern_; }
+    bool isCaseSensitive() const { return case_sensitive_; }
+    // higher weights win, then case sensitive globs, then longer patterns.
+    bool isBetterThan(const FreeDesktopMimeGlob *other) const {
+      if(other == nullptr) return true;
+      if(weight_ != other->weight_) return weight_ > other->weight_;
+      if(case_sensitive_ != other->case_sensitive_) return case_sensitive_;
+      return pattern_.size() > other->pattern_.size();
+    }
+
+  protected:
+    int weight_;
+    std::size_t type_;
+    std::string pattern_;
+    bool case_sensitive_;
+}; // }}}
+
+// Globs are classified like xdgmime does: literal names and '*.ext' style
+// suffixes are looked up by hash, and only the remaining globs are matched
+// one by one.
 class FreeDesktopMime: private ib::NonCopyable<FreeDesktopMime> { // {{{
   public:
     static FreeDesktopMime *instance_;
     static FreeDesktopMime* inst() { return instance_; }
     static void init() { instance_ = new FreeDesktopMime(); instance_->build();}
 
-    FreeDesktopMime() : globs_() {};
+    FreeDesktopMime() : types_(), literals_(), suffixes_(), max_suffix_length_(0), globs_() {};
     void build();
-    bool findByPath(std::string &typ, std::string &subtyp, const char *path);
+    bool findByPath(std::string &typ, std::string &subtyp, const char *path) const;
+    bool findByName(std::string &typ, std::string &subtyp, const char *name) const;
+    bool findByExtension(std::string &typ, std::string &subtyp, const char *ext) const;
   protected:
-    std::vector<std::tuple<int, std::string, std::string, std::string> > globs_;
+    void addGlob(const int weight, const std::size_t type, const std::string &glob, const bool case_sensitive);
+    bool setType(std::string &typ, std::string &subtyp, const FreeDesktopMimeGlob *glob) const;
+    const FreeDesktopMimeGlob* findSuffix(const std::string &name, const std::string &lname, const std::size_t length) const;
+
+    // (type, subtype)
+    std::vector<std::pair<std::string, std::string> > types_;
+    // lowercased literal name -> globs
+    std::unordered_map<std::string, std::vector<FreeDesktopMimeGlob> > literals_;
+    // lowercased suffix(without '*') -> globs
+    std::unordered_map<std::string, std::vector<FreeDesktopMimeGlob> > suffixes_;
+    std::size_t max_suffix_length_;
+    std::vector<FreeDesktopMimeGlob> globs_;
 };
 
 FreeDesktopMime* FreeDesktopMime::instance_ = nullptr;
 
+static std::string mime_lower(const std::string &value) {
+  std::string result(value);
+  for(auto &c : result) {
+    if(c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+  }
+  return result;
+}
+
 void FreeDesktopMime::build() {
   const char *files[] = {"/usr/share/mime/globs2", "/usr/share/mime/globs"};
   for(int i = 0; i < 2; i++) {
@@ -256,25 +305,73 @@ void FreeDesktopMime::build() {
     if (ifs.fail()) {
       continue;
     }
-    ib::Regex reg("\\s*(?:([0-9]+):)?([^:/]+)/([^:/]+):(.*)", ib::Regex::I);
+    ib::Regex reg("\\s*(?:([0-9]+):)?([^:/]+)/([^:/]+):([^:]*)(?::(.*))?", ib::Regex::I);
     reg.init();
 
+    std::unordered_map<std::string, std::size_t> type_indicies;
     while(std::getline(ifs, line)) {
       if(reg.match(line) == 0) {
         auto scorestr = reg._1();
         auto typ      = reg._2();
         auto subtyp   = reg._3();
         auto glob     = reg._4();
-        int score = 0;
+        auto flags    = reg._5();
+        // the weight defaults to 50 in the old globs format.
+        int score = 50;
         if(!scorestr.empty()) score = std::atoi(scorestr.c_str());
-        globs_.push_back(std::make_tuple(score, typ, subtyp, glob));
+        auto case_sensitive = flags == "cs" || flags.find("cs,") == 0 || flags.find(",cs") != std::string::npos;
+        auto key = typ + "/" + subtyp;
+        auto type = type_indicies.find(key);
+        if(type == type_indicies.end()) {
+          type = type_indicies.insert(std::make_pair(key, types_.size())).first;
+          types_.push_back(std::make_pair(typ, subtyp));
+        }
+        addGlob(score, (*type).second, glob, case_sensitive);
       }
     }
     break;
   }
 }
 
-bool FreeDesktopMime::findByPath(std::string &typ, std::string &subtyp, const char *path) {
+void FreeDesktopMime::addGlob(const int weight, const std::size_t type, const std::string &glob, const bool case_sensitive) {
+  if(glob.empty()) return;
+
+  const auto wildcard = glob.find_first_of("*?[");
+  if(wildcard == std::string::npos) {
+    literals_[mime_lower(glob)].push_back(FreeDesktopMimeGlob(weight, type, glob, case_sensitive));
+  } else if(wildcard == 0 && glob[0] == '*' && glob.size() > 1 && glob.find_first_of("*?[", 1) == std::string::npos) {
+    const auto suffix = glob.substr(1);
+    suffixes_[mime_lower(suffix)].push_back(FreeDesktopMimeGlob(weight, type, suffix, case_sensitive));
+    max_suffix_length_ = std::max<std::size_t>(max_suffix_length_, suffix.size());
+  } else {
+    globs_.push_back(FreeDesktopMimeGlob(weight, type, case_sensitive ? glob : mime_lower(glob), case_sensitive));
+  }
+}
+
+bool FreeDesktopMime::setType(std::string &typ, std::string &subtyp, const FreeDesktopMimeGlob *glob) const {
+  if(glob == nullptr) return false;
+  typ = types_[glob->getType()].first;
+  subtyp = types_[glob->getType()].second;
+  return true;
+}
+
+// finds the best glob matching the last `length` bytes(at most) of the name.
+const FreeDesktopMimeGlob* FreeDesktopMime::findSuffix(const std::string &name, const std::string &lname, const std::size_t length) const {
+  const FreeDesktopMimeGlob *found = nullptr;
+  const auto max_length = std::min<std::size_t>(length, max_suffix_length_);
+  for(std::size_t i = 1; i <= max_length; i++) {
+    const auto pos = lname.size() - i;
+    auto it = suffixes_.find(lname.substr(pos));
+    if(it == suffixes_.end()) continue;
+    for(const auto &glob : (*it).second) {
+      if(glob.isCaseSensitive() && name.compare(pos, i, glob.getPattern()) != 0) continue;
+      if(glob.isBetterThan(found)) found = &glob;
+    }
+  }
+  return found;
+}
+
+bool FreeDesktopMime::findByPath(std::string &typ, std::string &subtyp, const char *path) const {
   char name[IB_MAX_PATH];
   ib::platform::basename(name, path);
   if(ib::platform::directory_exists(path)) {
@@ -282,203 +379,415 @@ bool FreeDesktopMime::findByPath(std::string &typ, std::string &subtyp, const ch
     subtyp = "directory";
     return true;
   }
-  for(const auto &tup : globs_){
-    auto &glob = std::get<3>(tup);
-    if(fl_filename_match(name, glob.c_str())) {
-      typ = std::get<1>(tup);
-      subtyp = std::get<2>(tup);
-      return true;
+  return findByName(typ, subtyp, name);
+}
+
+bool FreeDesktopMime::findByName(std::string &typ, std::string &subtyp, const char *name) const {
+  const std::string sname(name);
+  const auto lname = mime_lower(sname);
+  const FreeDesktopMimeGlob *found = nullptr;
+
+  auto it = literals_.find(lname);
+  if(it != literals_.end()) {
+    for(const auto &glob : (*it).second) {
+      if(glob.isCaseSensitive() && glob.getPattern() != sname) continue;
+      if(glob.isBetterThan(found)) found = &glob;
     }
   }
-  return false;
+  if(found != nullptr) return setType(typ, subtyp, found);
+
+  found = findSuffix(sname, lname, lname.size());
+  if(found != nullptr) return setType(typ, subtyp, found);
+
+  for(const auto &glob : globs_){
+    if(fl_filename_match(glob.isCaseSensitive() ? name : lname.c_str(), glob.getPattern().c_str()) && glob.isBetterThan(found)) {
+      found = &glob;
+    }
+  }
+  return setType(typ, subtyp, found);
+}
+
+// ext includes the leading dot, as ib::platform::file_type returns.
+bool FreeDesktopMime::findByExtension(std::string &typ, std::string &subtyp, const char *ext) const {
+  const std::string name(ext);
+  return setType(typ, subtyp, findSuffix(name, mime_lower(name), name.size()));
 }
 
 //}}}
 
+// helpers for the icon theme cache {{{
+static void cache_write_u32(std::string &buf, const ib::u32 value) {
+  char bytes[4];
+  ib::utils::u32int2bebytes(bytes, value);
+  buf.append(bytes, 4);
+}
+
+static void cache_write_u64(std::string &buf, const unsigned long long value) {
+  cache_write_u32(buf, (ib::u32)(value >> 32));
+  cache_write_u32(buf, (ib::u32)(value & 0xffffffff));
+}
+
+static void cache_write_string(std::string &buf, const std::string &value) {
+  cache_write_u32(buf, (ib::u32)value.size());
+  buf += value;
+}
+
+// returns 0 if the path does not exist.
+static unsigned long long path_mtime(const char *path) {
+  struct stat st;
+  if(stat(path, &st) < 0) return 0;
+  return (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + (unsigned long long)st.st_mtim.tv_nsec;
+}
+
+class FreeDesktopCacheReader : private ib::NonCopyable<FreeDesktopCacheReader> { // {{{
+  public:
+    FreeDesktopCacheReader(const char *data, const std::size_t size) : ptr_(data), end_(data + size), valid_(data != nullptr) {}
+    bool isValid() const { return valid_; }
+    bool isEnd() const { return ptr_ == end_; }
+    void invalidate() { valid_ = false; }
+
+    ib::u32 readU32() {
+      if(!valid_ || end_ - ptr_ < 4) { valid_ = false; return 0; }
+      auto value = ib::utils::bebytes2u32int(ptr_);
+      ptr_ += 4;
+      return value;
+    }
+
+    unsigned long long readU64() {
+      auto high = (unsigned long long)readU32();
+      return (high << 32) | (unsigned long long)readU32();
+    }
+
+    std::string readString() {
+      auto size = (std::size_t)readU32();
+      if(!valid_ || (std::size_t)(end_ - ptr_) < size) { valid_ = false; return ""; }
+      std::string value(ptr_, size);
+      ptr_ += size;
+      return value;
+    }
+
+  protected:
+    const char *ptr_;
+    const char *end_;
+    bool valid_;
+}; // }}}
+// }}}
+
+class FreeDesktopIconDirectory { // {{{
+  public:
+    static const int FIXED     = 1;
+    static const int SCALABLE  = 2;
+    static const int THRESHOLD = 3;
+
+    FreeDesktopIconDirectory() : path_(), type_(0), size_(0), min_size_(0), max_size_(0), threshold_(2), mtime_(0) {}
+    void parse(FreeDesktopKVFile *kvf, const char *theme_dir, const std::string &dir);
+    void write(std::string &buf) const;
+    void read(FreeDesktopCacheReader &reader);
+    bool isModified() const { return path_mtime(path_.c_str()) != mtime_; }
+
+    const std::string& getPath() const { return path_; }
+    int getType() const { return type_; }
+    bool matchSize(const int size) const;
+    int sizeDistance(const int size) const;
+
+  protected:
+    std::string path_;
+    int type_;
+    int size_;
+    int min_size_;
+    int max_size_;
+    int threshold_;
+    unsigned long long mtime_;
+}; // }}}
+
+class FreeDesktopIconEntry { // {{{
+  public:
+    static const char* const EXTENSIONS[];
+    static const int NUM_EXTENSIONS = 3;
+
+    FreeDesktopIconEntry(const unsigned int directory, const int extension) : directory_(directory), extension_(extension) {}
+    unsigned int getDirectory() const { return directory_; }
+    int getExtension() const { return extension_; }
+    bool operator<(const FreeDesktopIconEntry &rhs) const {
+      return directory_ != rhs.directory_ ? directory_ < rhs.directory_ : extension_ < rhs.extension_;
+    }
+
+  protected:
+    unsigned int directory_;
+    int extension_;
+}; // }}}
+
+// Icons in a theme are indexed by names when the theme is loaded, so
+// that a lookup does not touch the filesystem.
+class FreeDesktopIconTheme : private ib::NonCopyable<FreeDesktopIconTheme> { // {{{
+  public:
+    FreeDesktopIconTheme() : name_(), index_path_(), index_mtime_(0), parents_(), directories_(), icons_() {}
+    void build(FreeDesktopKVFile *kvf);
+    void write(std::string &buf) const;
+    void read(FreeDesktopCacheReader &reader);
+    bool isModified() const;
+    const std::string& getName() const { return name_; }
+    const std::vector<std::string>& getParents() const { return parents_; }
+    void lookup(std::string &result, const char *name, const int size) const;
+
+  protected:
+    std::string name_;
+    std::string index_path_;
+    unsigned long long index_mtime_;
+    std::vector<std::string> parents_;
+    std::vector<FreeDesktopIconDirectory> directories_;
+    std::unordered_map<std::string, std::vector<FreeDesktopIconEntry>> icons_;
+}; // }}}
+
 class FreeDesktopThemeRepos : private ib::NonCopyable<FreeDesktopThemeRepos> { // {{{
   public:
     static FreeDesktopThemeRepos *instance_;
     static FreeDesktopThemeRepos* inst() { return instance_; }
-    static void init() { instance_ = new FreeDesktopThemeRepos(); instance_->build();}
+    static void init() { instance_ = new FreeDesktopThemeRepos(); instance_->load();}
 
-    FreeDesktopThemeRepos() : indicies_() {};
-    void build();
-    FreeDesktopKVFile* getTheme(const char *name) const;
+    FreeDesktopThemeRepos() : indicies_(), pixmaps_() {};
+    void load();
+    void build(const std::vector<std::string> &roots);
+    const FreeDesktopIconTheme* getTheme(const char *name) const;
     void findIcon(std::string &result, const char *theme, const char *name, int size);
 
   protected:
-    std::map<std::string, std::unique_ptr<FreeDesktopKVFile> > indicies_;
+    std::map<std::string, std::unique_ptr<FreeDesktopIconTheme> > indicies_;
+    // icon name -> path in /usr/share/pixmaps
+    std::unordered_map<std::string, std::string> pixmaps_;
+    static const char CACHE_MAGIC[];
+    static const ib::u32 CACHE_VERSION = 1;
+    static void getRootPaths(std::vector<std::string> &result);
+    bool readCache(const std::vector<std::string> &roots);
+    void writeCache(const std::vector<std::string> &roots) const;
     void buildHelper(const char *basepath);
+    void findHelper(std::string &result, const char *theme, const char *name, int size, int depth) const;
 
-};
+}; // }}}
 
-class FreeDesktopIconFinder : private ib::NonCopyable<FreeDesktopIconFinder> { // {{{
-  public:
-    FreeDesktopIconFinder(const char *name, const int size) : name_(name), size_(size) {};
+// class FreeDesktopIconDirectory {{{
+void FreeDesktopIconDirectory::parse(FreeDesktopKVFile *kvf, const char *theme_dir, const std::string &dir) {
+  path_ = theme_dir;
+  path_ += "/";
+  path_ += dir;
+  mtime_ = path_mtime(path_.c_str());
 
-    void find(std::string &result);
-  protected:
-    const char *name_;
-    const int   size_;
-
-    void findHelper(std::string &result, const char *theme);
-    void lookup(std::string &result, const char *theme);
-    bool directoryMatchSize(const char *dir, const char *theme);
-    int directorySizeDistance(const char *dir, const char *theme);
-    std::tuple<std::string, int,int,int,int> getDirectorySizes(const char *dir, const char *theme);
-};
+  const auto typ = kvf->get(dir.c_str(), "Type", false);
+  if(typ == "Fixed") {
+    type_ = FIXED;
+  } else if(typ == "Scalable") {
+    type_ = SCALABLE;
+  } else if(typ == "Threshold" || typ.empty()){
+    type_ = THRESHOLD;
+  }
+  size_ = std::atoi(kvf->get(dir.c_str(), "Size", false).c_str());
+  min_size_ = size_;
+  max_size_ = size_;
+  const auto minstr = kvf->get(dir.c_str(), "MinSize", false);
+  const auto maxstr = kvf->get(dir.c_str(), "MaxSize", false);
+  if(!minstr.empty()) min_size_ = std::atoi(minstr.c_str());
+  if(!maxstr.empty()) max_size_ = std::atoi(maxstr.c_str());
+  const auto thstr = kvf->get(dir.c_str(), "Threshold", false);
+  if(!thstr.empty()) threshold_ = std::atoi(thstr.c_str());
+}
 
-void FreeDesktopIconFinder::find(std::string &result) {
-  const auto theme = ib::Singleton<ib::Config>::getInstance()->getIconTheme().c_str();
-  findHelper(result, theme);
-  if(!result.empty()) return;
-  findHelper(result, "default");
-  if(!result.empty()) return;
-  findHelper(result, "Hicolor");
-  if(!result.empty()) return;
+void FreeDesktopIconDirectory::write(std::string &buf) const {
+  cache_write_string(buf, path_);
+  cache_write_u32(buf, (ib::u32)type_);
+  cache_write_u32(buf, (ib::u32)size_);
+  cache_write_u32(buf, (ib::u32)min_size_);
+  cache_write_u32(buf, (ib::u32)max_size_);
+  cache_write_u32(buf, (ib::u32)threshold_);
+  cache_write_u64(buf, mtime_);
+}
 
-  const char *pixmaps = "/usr/share/pixmaps";
-  char icon_file[IB_MAX_PATH];
-  const char *exts[] = {"png", "svg", "xpm"};
-  for(int i = 0; i < 3; i++) {
-    const auto ext = exts[i];
-    snprintf(icon_file, IB_MAX_PATH, "%s/%s.%s", pixmaps, name_, ext);
-    if(ib::platform::path_exists(icon_file)) {
-      result = icon_file;
-      return;
+void FreeDesktopIconDirectory::read(FreeDesktopCacheReader &reader) {
+  path_ = reader.readString();
+  type_ = (int)reader.readU32();
+  size_ = (int)reader.readU32();
+  min_size_ = (int)reader.readU32();
+  max_size_ = (int)reader.readU32();
+  threshold_ = (int)reader.readU32();
+  mtime_ = reader.readU64();
+}
+
+bool FreeDesktopIconDirectory::matchSize(const int size) const {
+  switch(type_) {
+    case FIXED:
+      return size_ == size;
+    case SCALABLE:
+      return min_size_ <= size && size <= max_size_;
+    case THRESHOLD:
+      return (size_ - threshold_) <= size && size <= (size_ + threshold_);
+  }
+  return false;
+}
+
+int FreeDesktopIconDirectory::sizeDistance(const int size) const {
+  switch(type_) {
+    case FIXED:
+      return std::abs(size_ - size);
+    case SCALABLE:
+      if(size < min_size_) return min_size_ - size;
+      if(size > max_size_) return size - max_size_;
+      return 0;
+    case THRESHOLD:
+      if(size < (size_ - threshold_)) return (size_ - threshold_) - size;
+      if(size > (size_ + threshold_)) return size - (size_ + threshold_);
+      return 0;
+  }
+  return 0;
+}
+// }}}
+
+// class FreeDesktopIconTheme {{{
+const char* const FreeDesktopIconEntry::EXTENSIONS[] = {"png", "svg", "xpm"};
+
+static int icon_extension_index(const char *file, std::size_t &basename_length) {
+  const auto dot = strrchr(file, '.');
+  if(dot == nullptr || dot == file) return -1;
+  for(int i = 0; i < FreeDesktopIconEntry::NUM_EXTENSIONS; i++) {
+    if(strcmp(dot+1, FreeDesktopIconEntry::EXTENSIONS[i]) == 0) {
+      basename_length = dot - file;
+      return i;
     }
   }
+  return -1;
 }
 
-void FreeDesktopIconFinder::findHelper(std::string &result, const char *theme) {
-  lookup(result, theme);
-  if(!result.empty()) return;
-  auto kvf = FreeDesktopThemeRepos::inst()->getTheme(theme);
-  if(kvf == nullptr) return;
+void FreeDesktopIconTheme::build(FreeDesktopKVFile *kvf) {
+  name_ = kvf->get("Icon Theme", "Name", false);
+  index_path_ = kvf->getPath();
+  index_mtime_ = path_mtime(index_path_.c_str());
+
   auto parents = kvf->get("Icon Theme", "Inherits", false);
-  if(parents.empty() && strcmp(theme, "Hicolor") != 0) parents = "Hicolor";
-  std::istringstream stream(parents);
+  if(parents.empty() && name_ != "Hicolor") parents = "Hicolor";
+  std::istringstream pstream(parents);
   std::string parent;
-  while (std::getline(stream, parent, ',')) {
-    findHelper(result, parent.c_str());
-    if(!result.empty()) return;
+  while (std::getline(pstream, parent, ',')) {
+    parents_.push_back(parent);
   }
-}
 
-void FreeDesktopIconFinder::lookup(std::string &result, const char *theme) {
-  auto kvf = FreeDesktopThemeRepos::inst()->getTheme(theme);
-  if(kvf == nullptr) return;
-  auto dirs = kvf->get("Icon Theme", "Directories", false);
   char theme_dir[IB_MAX_PATH];
   ib::platform::dirname(theme_dir, kvf->getPath());
+  auto dirs = kvf->get("Icon Theme", "Directories", false);
   std::istringstream stream(dirs);
   std::string dir;
-  char icon_file[IB_MAX_PATH];
   while (std::getline(stream, dir, ',')) {
-    if(directoryMatchSize(dir.c_str(), theme)) {
-      const char *exts[] = {"png", "svg", "xpm"};
-      for(int i = 0; i < 3; i++) {
-        const auto ext = exts[i];
-        snprintf(icon_file, IB_MAX_PATH, "%s/%s/%s.%s", theme_dir, dir.c_str(), name_, ext);
-        if(ib::platform::path_exists(icon_file)) {
-          result = icon_file;
-          return;
-        }
-      }
+    FreeDesktopIconDirectory directory;
+    directory.parse(kvf, theme_dir, dir);
+    const auto index = (unsigned int)directories_.size();
+    directories_.push_back(directory);
+
+    auto d = opendir(directory.getPath().c_str());
+    if(d == nullptr) continue;
+    while(auto entry = readdir(d)) {
+      std::size_t length = 0;
+      const auto ext = icon_extension_index(entry->d_name, length);
+      if(ext < 0) continue;
+      icons_[std::string(entry->d_name, length)].push_back(FreeDesktopIconEntry(index, ext));
     }
+    closedir(d);
   }
+  // entries are searched in the order of directories and extensions.
+  for(auto &icon : icons_) {
+    std::sort(icon.second.begin(), icon.second.end());
+  }
+}
 
-  int minsize = INT_MAX;
-  std::istringstream stream2(dirs);
-  while (std::getline(stream2, dir, ',')) {
-    const char *exts[] = {"png", "svg", "xpm"};
-    for(int i = 0; i < 3; i++) {
-      const auto ext = exts[i];
-      snprintf(icon_file, IB_MAX_PATH, "%s/%s/%s.%s", theme_dir, dir.c_str(), name_, ext);
-      if(ib::platform::path_exists(icon_file)){
-        auto distance = directorySizeDistance(dir.c_str(), theme);
-        if(distance < minsize) {
-          result = icon_file;
-          minsize = distance;
-        }
-      }
+void FreeDesktopIconTheme::write(std::string &buf) const {
+  cache_write_string(buf, name_);
+  cache_write_string(buf, index_path_);
+  cache_write_u64(buf, index_mtime_);
+  cache_write_u32(buf, (ib::u32)parents_.size());
+  for(const auto &parent : parents_) cache_write_string(buf, parent);
+  cache_write_u32(buf, (ib::u32)directories_.size());
+  for(const auto &directory : directories_) directory.write(buf);
+  cache_write_u32(buf, (ib::u32)icons_.size());
+  for(const auto &icon : icons_) {
+    cache_write_string(buf, icon.first);
+    cache_write_u32(buf, (ib::u32)icon.second.size());
+    for(const auto &entry : icon.second) {
+      cache_write_u32(buf, entry.getDirectory());
+      cache_write_u32(buf, (ib::u32)entry.getExtension());
     }
   }
-
 }
 
-std::tuple<std::string, int,int,int,int> FreeDesktopIconFinder::getDirectorySizes(const char *dir, const char *theme) {
-  std::string typ;
-  int size, min, max, th = 0;
-  const auto kvf = FreeDesktopThemeRepos::inst()->getTheme(theme);
-  if(kvf != nullptr) {
-    typ = kvf->get(dir, "Type", false);
-    if(typ.empty()) typ = "Threshold";
-    size = std::atoi(kvf->get(dir, "Size", false).c_str());
-    min = size;
-    max = size;
-    const auto minstr = kvf->get(dir, "MinSize", false);
-    const auto maxstr = kvf->get(dir, "MaxSize", false);
-    if(!minstr.empty()) min = std::atoi(minstr.c_str());
-    if(!maxstr.empty()) max = std::atoi(maxstr.c_str());
-    th = 2;
-    const auto thstr = kvf->get(dir, "Threshold", false);
-    if(!thstr.empty()) th = std::atoi(thstr.c_str());
-  }
-
-  return std::make_tuple(typ, size, min, max, th);
-
+void FreeDesktopIconTheme::read(FreeDesktopCacheReader &reader) {
+  name_ = reader.readString();
+  index_path_ = reader.readString();
+  index_mtime_ = reader.readU64();
+  auto size = reader.readU32();
+  for(ib::u32 i = 0; i < size && reader.isValid(); i++) parents_.push_back(reader.readString());
+  size = reader.readU32();
+  for(ib::u32 i = 0; i < size && reader.isValid(); i++) {
+    directories_.push_back(FreeDesktopIconDirectory());
+    directories_.back().read(reader);
+  }
+  size = reader.readU32();
+  icons_.reserve(size);
+  for(ib::u32 i = 0; i < size && reader.isValid(); i++) {
+    auto &entries = icons_[reader.readString()];
+    auto nentries = reader.readU32();
+    for(ib::u32 j = 0; j < nentries && reader.isValid(); j++) {
+      auto directory = reader.readU32();
+      auto extension = (int)reader.readU32();
+      if(directory >= directories_.size() || extension < 0 || extension >= FreeDesktopIconEntry::NUM_EXTENSIONS) {
+        reader.invalidate();
+        break;
+      }
+      entries.push_back(FreeDesktopIconEntry(directory, extension));
+    }
+  }
 }
 
-bool FreeDesktopIconFinder::directoryMatchSize(const char *dir, const char *theme) {
-  const auto sizedata = getDirectorySizes(dir, theme);
-  const auto typ = std::get<0>(sizedata);
-  const auto size = std::get<1>(sizedata);
-  const auto min = std::get<2>(sizedata);
-  const auto max = std::get<3>(sizedata);
-  const auto th  = std::get<4>(sizedata);
-
-  if(typ == "Fixed") {
-    return size == size_;
-  } else if(typ == "Scalable") {
-    return min <= size_ && size_ <= max;
-  } else if(typ == "Threshold"){
-    return (size - th) <= size_ && size_ <= (size + th);
+bool FreeDesktopIconTheme::isModified() const {
+  if(path_mtime(index_path_.c_str()) != index_mtime_) return true;
+  for(const auto &directory : directories_) {
+    if(directory.isModified()) return true;
   }
   return false;
 }
 
-int FreeDesktopIconFinder::directorySizeDistance(const char *dir, const char *theme) {
-  const auto sizedata = getDirectorySizes(dir, theme);
-  const auto &typ = std::get<0>(sizedata);
-  const auto size = std::get<1>(sizedata);
-  const auto min = std::get<2>(sizedata);
-  const auto max = std::get<3>(sizedata);
-  const auto th  = std::get<4>(sizedata);
-  if(typ == "Fixed") {
-    return std::abs(size - size_);
-  } else if(typ == "Scalable") {
-    if(size_ < min) return min- size_;
-    if(size_ > max) return size_ - max;
-    return 0;
-  } else if(typ == "Threshold"){
-    if(size_ < (size - th)) return (size - th) - size_;
-    if(size_ > (size + th)) return size_ - (size + th);
-    return 0;
+void FreeDesktopIconTheme::lookup(std::string &result, const char *name, const int size) const {
+  auto it = icons_.find(name);
+  if(it == icons_.end()) return;
+  const auto &entries = (*it).second;
+
+  const FreeDesktopIconEntry *found = nullptr;
+  int minsize = INT_MAX;
+  for(const auto &entry : entries) {
+    const auto &directory = directories_.at(entry.getDirectory());
+    if(directory.matchSize(size)) {
+      found = &entry;
+      break;
+    }
+    auto distance = directory.sizeDistance(size);
+    if(distance < minsize) {
+      found = &entry;
+      minsize = distance;
+    }
   }
-  return 0;
+  if(found == nullptr) return;
+  result = directories_.at(found->getDirectory()).getPath();
+  result += "/";
+  result += name;
+  result += ".";
+  result += FreeDesktopIconEntry::EXTENSIONS[found->getExtension()];
 }
 // }}}
 
+// class FreeDesktopThemeRepos {{{
 FreeDesktopThemeRepos *FreeDesktopThemeRepos::instance_ = nullptr;
 
-void FreeDesktopThemeRepos::build() {
+const char FreeDesktopThemeRepos::CACHE_MAGIC[] = "IBIT";
+
+void FreeDesktopThemeRepos::getRootPaths(std::vector<std::string> &result) {
   char path[IB_MAX_PATH];
   snprintf(path, IB_MAX_PATH, "%s/.icons", getenv("HOME"));
-  buildHelper(path);
-
-  snprintf(path, IB_MAX_PATH, "/usr/share/icons");
-  buildHelper(path);
+  result.push_back(path);
+  result.push_back("/usr/share/icons");
 
   if(getenv("XDG_DATA_DIRS") != nullptr) {
     ib::Regex sep(":", ib::Regex::I);
@@ -486,12 +795,120 @@ void FreeDesktopThemeRepos::build() {
     auto parts = sep.split(getenv("XDG_DATA_DIRS"));
     for(const auto &part : parts) {
       snprintf(path, IB_MAX_PATH, "%s/icons", part.c_str());
-      buildHelper(path);
+      result.push_back(path);
     }
   }
 
-  snprintf(path, IB_MAX_PATH, "/usr/share/pixmaps");
-  buildHelper(path);
+  // must be the last one, pixmaps are indexed from here.
+  result.push_back("/usr/share/pixmaps");
+}
+
+void FreeDesktopThemeRepos::load() {
+  std::vector<std::string> roots;
+  getRootPaths(roots);
+  if(readCache(roots)) return;
+
+  indicies_.clear();
+  pixmaps_.clear();
+  build(roots);
+  writeCache(roots);
+}
+
+// The cache is valid while the mtimes of the theme roots, index.theme files
+// and icon directories are unchanged. Adding or removing a theme changes
+// the mtime of its root, adding or removing an icon changes the mtime of
+// its directory.
+bool FreeDesktopThemeRepos::readCache(const std::vector<std::string> &roots) {
+  const auto &cache_path = ib::Singleton<ib::Config>::getInstance()->getIconThemeCachePath();
+  if(cache_path.empty()) return false;
+
+  ib::Error error;
+  ib::platform::MappedFile file;
+  if(file.open(ib::platform::utf82oschar(cache_path.c_str()).get(), error) != 0) return false;
+  if(file.getSize() < 4 || memcmp(file.getData(), CACHE_MAGIC, 4) != 0) return false;
+
+  FreeDesktopCacheReader reader(file.getData() + 4, file.getSize() - 4);
+  if(reader.readU32() != CACHE_VERSION) return false;
+  if(reader.readU32() != roots.size()) return false;
+  for(const auto &root : roots) {
+    if(reader.readString() != root) return false;
+    if(reader.readU64() != path_mtime(root.c_str())) return false;
+  }
+
+  auto size = reader.readU32();
+  for(ib::u32 i = 0; i < size && reader.isValid(); i++) {
+    auto key = reader.readString();
+    std::unique_ptr<FreeDesktopIconTheme> theme(new FreeDesktopIconTheme());
+    theme->read(reader);
+    if(!reader.isValid() || theme->isModified()) return false;
+    indicies_.insert(std::make_pair(key, std::move(theme)));
+  }
+  size = reader.readU32();
+  for(ib::u32 i = 0; i < size && reader.isValid(); i++) {
+    auto name = reader.readString();
+    pixmaps_[name] = reader.readString();
+  }
+  return reader.isValid() && reader.isEnd();
+}
+
+void FreeDesktopThemeRepos::writeCache(const std::vector<std::string> &roots) const {
+  const auto &cache_path = ib::Singleton<ib::Config>::getInstance()->getIconThemeCachePath();
+  if(cache_path.empty()) return;
+
+  std::string buf(CACHE_MAGIC, 4);
+  cache_write_u32(buf, CACHE_VERSION);
+  cache_write_u32(buf, (ib::u32)roots.size());
+  for(const auto &root : roots) {
+    cache_write_string(buf, root);
+    cache_write_u64(buf, path_mtime(root.c_str()));
+  }
+  cache_write_u32(buf, (ib::u32)indicies_.size());
+  for(const auto &index : indicies_) {
+    cache_write_string(buf, index.first);
+    index.second->write(buf);
+  }
+  cache_write_u32(buf, (ib::u32)pixmaps_.size());
+  for(const auto &pixmap : pixmaps_) {
+    cache_write_string(buf, pixmap.first);
+    cache_write_string(buf, pixmap.second);
+  }
+
+  ib::Error error;
+  auto tmp_path = cache_path + ".tmp";
+  auto ostmp_path = ib::platform::utf82oschar(tmp_path.c_str());
+  auto fp = std::fopen(ib::platform::utf82local(tmp_path.c_str()).get(), "wb");
+  auto ok = fp != nullptr && std::fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+  if(fp != nullptr) std::fclose(fp);
+  if(ok) {
+    ok = ib::platform::rename_file(ostmp_path.get(), ib::platform::utf82oschar(cache_path.c_str()).get(), error) == 0;
+  }
+  if(!ok) {
+    ib::platform::remove_file(ostmp_path.get(), error); // ignore errors
+  }
+}
+
+void FreeDesktopThemeRepos::build(const std::vector<std::string> &roots) {
+  for(const auto &root : roots) {
+    buildHelper(root.c_str());
+  }
+
+  const auto path = roots.back().c_str();
+
+  auto d = opendir(path);
+  if(d != nullptr) {
+    std::unordered_map<std::string, int> exts;
+    while(auto entry = readdir(d)) {
+      std::size_t length = 0;
+      const auto ext = icon_extension_index(entry->d_name, length);
+      if(ext < 0) continue;
+      std::string name(entry->d_name, length);
+      auto it = exts.find(name);
+      if(it != exts.end() && (*it).second < ext) continue;
+      exts[name] = ext;
+      pixmaps_[name] = std::string(path) + "/" + entry->d_name;
+    }
+    closedir(d);
+  }
 }
 
 void FreeDesktopThemeRepos::buildHelper(const char *basepath) {
@@ -511,23 +928,36 @@ void FreeDesktopThemeRepos::buildHelper(const char *basepath) {
         auto kvf = new FreeDesktopKVFile(index_path);
         if(kvf->parse() < 0) { delete kvf; continue; /* ignore errors */ }
         auto name = kvf->get("Icon Theme", "Name", false);
-        if(name.empty()) {
+        if(name.empty() || indicies_.find(name) != indicies_.end()) {
           delete kvf;
           continue;
           // TODO How we should handle an inheritance?
         }
-        indicies_.insert(std::make_pair(name, std::unique_ptr<FreeDesktopKVFile>(kvf)));
+        auto theme = new FreeDesktopIconTheme();
+        theme->build(kvf);
+        delete kvf;
+        indicies_.insert(std::make_pair(name, std::unique_ptr<FreeDesktopIconTheme>(theme)));
       }
     }
   }
 }
 
-FreeDesktopKVFile* FreeDesktopThemeRepos::getTheme(const char *name) const {
+const FreeDesktopIconTheme* FreeDesktopThemeRepos::getTheme(const char *name) const {
   auto themeptr = indicies_.find(name);
   if(themeptr == indicies_.end()) return nullptr;
   return themeptr->second.get();
 }
 
+void FreeDesktopThemeRepos::findHelper(std::string &result, const char *theme, const char *name, int size, int depth) const {
+  auto t = getTheme(theme);
+  if(t == nullptr || depth > 16) return;
+  t->lookup(result, name, size);
+  if(!result.empty()) return;
+  for(const auto &parent : t->getParents()) {
+    findHelper(result, parent.c_str(), name, size, depth+1);
+    if(!result.empty()) return;
+  }
+}
 
 void FreeDesktopThemeRepos::findIcon(std::string &result, const char *theme, const char *name, int size) {
 
@@ -543,8 +973,16 @@ void FreeDesktopThemeRepos::findIcon(std::string &result, const char *theme, con
     }
   }
 
-  FreeDesktopIconFinder ficon(name, size);
-  ficon.find(result);
+  const auto config_theme = ib::Singleton<ib::Config>::getInstance()->getIconTheme().c_str();
+  findHelper(result, config_theme, name, size, 0);
+  if(!result.empty()) return;
+  findHelper(result, "default", name, size, 0);
+  if(!result.empty()) return;
+  findHelper(result, "Hicolor", name, size, 0);
+  if(!result.empty()) return;
+
+  auto it = pixmaps_.find(sname);
+  if(it != pixmaps_.end()) result = (*it).second;
 }
 
 // }}}
@@ -759,7 +1197,7 @@ static bool xis_gui_app(const char *path) {
   ib::Error e;
   char quoted[IB_MAX_PATH];
   ib::platform::quote_string(quoted, path);
-  if(ib::platform::command_output(out, err, ("ldd " + std::string(quoted)).c_str(), e) == 0) {
+  if(ib::platform::command_output(out, err, ("ldd " + std::string(quoted)).c_str(), HELPER_COMMAND_TIMEOUT, HELPER_COMMAND_MAX_SIZE, e) == 0) {
       std::istringstream stream(out);
       std::string   line;
       while(std::getline(stream, line)) {
@@ -1119,10 +1557,9 @@ int ib::platform::shell_execute(const std::string &path, const std::vector<std::
   return ib_platform_shell_execute(path, strparams, cwd, terminal, sudo, error);
 } /* }}} */
 
-int ib::platform::command_output(std::string &sstdout, std::string &sstderr, const char *cmd, ib::Error &error) { // {{{
+static pid_t spawn_command(int *fds, const char *cmd, ib::Error &error) { // {{{
   int outfd[2];
   int efd[2];
-  int infd[2];
   pid_t pid;
 
   std::vector<std::unique_ptr<char[]>> argv;
@@ -1137,7 +1574,14 @@ int ib::platform::command_output(std::string &sstdout, std::string &sstderr, con
   }
   cargv[argv.size()] = nullptr;
 
-  if(pipe(outfd) != 0 || pipe(infd) != 0 || pipe(efd) != 0) {
+  if(pipe(outfd) != 0) {
+    error.setMessage("Failed to create pipes.");
+    error.setCode(1);
+    return -1;
+  }
+  if(pipe(efd) != 0) {
+    close(outfd[0]);
+    close(outfd[1]);
     error.setMessage("Failed to create pipes.");
     error.setCode(1);
     return -1;
@@ -1146,11 +1590,16 @@ int ib::platform::command_output(std::string &sstdout, std::string &sstderr, con
   pid = fork();
   if(pid < 0) {
     set_errno(error);
+    close(outfd[0]);
+    close(outfd[1]);
+    close(efd[0]);
+    close(efd[1]);
     return -1;
   } else if(pid == 0) {
-    if(infd[0] != STDIN_FILENO) {
-      dup2(infd[0], STDIN_FILENO);
-      close(infd[0]);
+    auto nullfd = open("/dev/null", O_RDONLY);
+    if(nullfd > -1 && nullfd != STDIN_FILENO) {
+      dup2(nullfd, STDIN_FILENO);
+      close(nullfd);
     }
     if(outfd[1] != STDOUT_FILENO) {
       dup2(outfd[1], STDOUT_FILENO);
@@ -1160,33 +1609,210 @@ int ib::platform::command_output(std::string &sstdout, std::string &sstderr, con
       dup2(efd[1], STDERR_FILENO);
       close(efd[1]);
     }
-    close(infd[1]);
     close(outfd[0]);
     close(efd[0]);
     execvp(cargv.get()[0],cargv.get());
     exit(127);
-  } else {
-    close(infd[0]);
-    close(outfd[1]);
-    close(efd[1]);
+  }
+  close(outfd[1]);
+  close(efd[1]);
+  fcntl(outfd[0], F_SETFD, FD_CLOEXEC);
+  fcntl(efd[0], F_SETFD, FD_CLOEXEC);
+  fds[0] = outfd[0];
+  fds[1] = efd[0];
+  return pid;
+} // }}}
+
+int ib::platform::command_output(std::string &sstdout, std::string &sstderr, const char *cmd, ib::Error &error) { // {{{
+  return ib::platform::command_output(sstdout, sstderr, cmd, 0, 0, error);
+} // }}}
+
+int ib::platform::command_output(std::string &sstdout, std::string &sstderr, const char *cmd, const int timeout, const std::size_t max_size, ib::Error &error) { // {{{
+  int fds[2];
+  const auto pid = spawn_command(fds, cmd, error);
+  if(pid < 0) return -1;
 
-    read_fd_all(outfd[0], sstdout); // ignore errors
-    read_fd_all(efd[0], sstderr); // ignore errors
-    int status;
-    auto ret = waitpid(pid, &status, WUNTRACED);
-    if (ret < 0 || !WIFEXITED(status)) {
-      close(infd[1]);
-      close(outfd[0]);
-      close(efd[0]);
+  // drains stdout and stderr at the same time, so the command never
+  // blocks on a full pipe.
+  struct pollfd pfds[2];
+  std::string *outputs[2] = {&sstdout, &sstderr};
+  for(int i = 0; i < 2; i++) {
+    pfds[i].fd = fds[i];
+    pfds[i].events = POLLIN;
+    pfds[i].revents = 0;
+  }
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  std::size_t total = 0;
+  int opened = 2;
+  bool killed = false;
+  char buf[4096];
+  while(opened > 0) {
+    int wait = -1;
+    if(timeout > 0) {
+      wait = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if(wait <= 0) {
+        error.setMessage("Command timed out.");
+        error.setCode(1);
+        killed = true;
+        break;
+      }
+    }
+    const auto ret = poll(pfds, 2, wait);
+    if(ret < 0) {
+      if(errno == EINTR) continue;
       set_errno(error);
-      return -1;
+      killed = true;
+      break;
+    }
+    for(int i = 0; i < 2; i++) {
+      if(pfds[i].fd < 0 || pfds[i].revents == 0) continue;
+      const auto n = read(pfds[i].fd, buf, sizeof(buf));
+      if(n > 0) {
+        auto size = static_cast<std::size_t>(n);
+        if(max_size > 0 && total + size > max_size) {
+          size = max_size - total;
+          killed = true;
+        }
+        outputs[i]->append(buf, size);
+        total += size;
+      } else if(n == 0 || (errno != EINTR && errno != EAGAIN)) {
+        close(pfds[i].fd);
+        pfds[i].fd = -1;
+        opened--;
+      }
+    }
+    if(killed) {
+      error.setMessage("Output is too large.");
+      error.setCode(1);
+      break;
     }
-    close(infd[1]);
-    close(outfd[0]);
-    close(efd[0]);
-    return WEXITSTATUS(status);
   }
-  return -1;
+
+  for(int i = 0; i < 2; i++) {
+    if(pfds[i].fd > -1) close(pfds[i].fd);
+  }
+  if(killed) kill(pid, SIGKILL);
+  int status;
+  auto ret = waitpid(pid, &status, WUNTRACED);
+  if(killed) return -1;
+  if (ret < 0 || !WIFEXITED(status)) {
+    set_errno(error);
+    return -1;
+  }
+  return WEXITSTATUS(status);
+} // }}}
+
+class AsyncCommandOutput : private ib::NonCopyable<AsyncCommandOutput> { // {{{
+  public:
+    AsyncCommandOutput(pid_t pid, int *fds, ib::platform::CommandOutputListener *listener, const std::size_t max_size) : pid_(pid), listener_(listener), max_size_(max_size), total_(0), killed_(false), error_() {
+      fds_[0] = fds[0];
+      fds_[1] = fds[1];
+    }
+    ~AsyncCommandOutput() { delete listener_; }
+
+    void start(const int timeout) {
+      for(int i = 0; i < 2; i++) {
+        fcntl(fds_[i], F_SETFL, fcntl(fds_[i], F_GETFL) | O_NONBLOCK);
+        Fl::add_fd(fds_[i], FL_READ, AsyncCommandOutput::readable, this);
+      }
+      if(timeout > 0) {
+        Fl::add_timeout(timeout/1000.0, AsyncCommandOutput::timedout, this);
+      }
+    }
+
+    static void readable(FL_SOCKET fd, void *data) {
+      auto self = reinterpret_cast<AsyncCommandOutput*>(data);
+      const int i = (self->fds_[0] == fd) ? 0 : 1;
+      char buf[4096];
+      const auto n = read(fd, buf, sizeof(buf));
+      if(n > 0) {
+        auto size = static_cast<std::size_t>(n);
+        if(self->max_size_ > 0 && self->total_ + size > self->max_size_) {
+          size = self->max_size_ - self->total_;
+          self->kill("Output is too large.");
+        }
+        self->total_ += size;
+        if(size > 0) {
+          if(i == 0) {
+            self->listener_->onStdout(buf, size);
+          }else{
+            self->listener_->onStderr(buf, size);
+          }
+        }
+      } else if(n == 0 || (errno != EINTR && errno != EAGAIN)) {
+        self->closeFd(i);
+      }
+      if(self->fds_[0] < 0 && self->fds_[1] < 0) self->finish();
+    }
+
+    static void timedout(void *data) {
+      auto self = reinterpret_cast<AsyncCommandOutput*>(data);
+      self->kill("Command timed out.");
+      self->finish();
+    }
+
+    static void reap(void *data) {
+      reinterpret_cast<AsyncCommandOutput*>(data)->finish();
+    }
+
+  protected:
+    void closeFd(const int i) {
+      if(fds_[i] < 0) return;
+      Fl::remove_fd(fds_[i], FL_READ);
+      close(fds_[i]);
+      fds_[i] = -1;
+    }
+
+    void kill(const char *message) {
+      if(killed_) return;
+      killed_ = true;
+      error_.setMessage(message);
+      error_.setCode(1);
+      closeFd(0);
+      closeFd(1);
+      ::kill(pid_, SIGKILL);
+    }
+
+    void finish() {
+      Fl::remove_timeout(AsyncCommandOutput::timedout, this);
+      int status;
+      const auto ret = waitpid(pid_, &status, WNOHANG);
+      if(ret == 0) {
+        // outputs are closed, but the command is still running
+        Fl::add_timeout(0.05, AsyncCommandOutput::reap, this);
+        return;
+      }
+      int code = -1;
+      if(!killed_) {
+        if(ret < 0 || !WIFEXITED(status)) {
+          set_errno(error_);
+        }else{
+          code = WEXITSTATUS(status);
+        }
+      }
+      listener_->onExit(code, error_);
+      delete this;
+    }
+
+    pid_t pid_;
+    int fds_[2];
+    ib::platform::CommandOutputListener *listener_;
+    std::size_t max_size_;
+    std::size_t total_;
+    bool killed_;
+    ib::Error error_;
+}; // }}}
+
+int ib::platform::command_output_async(const char *cmd, ib::platform::CommandOutputListener *listener, const int timeout, const std::size_t max_size, ib::Error &error) { // {{{
+  int fds[2];
+  const auto pid = spawn_command(fds, cmd, error);
+  if(pid < 0) {
+    delete listener;
+    return -1;
+  }
+  auto job = new AsyncCommandOutput(pid, fds, listener, max_size);
+  job->start(timeout);
+  return 0;
 } // }}}
 
 int ib::platform::show_context_menu(ib::oschar *path){ // {{{
@@ -1614,7 +2240,13 @@ ib::oschar* ib::platform::icon_cache_key(ib::oschar *result, const ib::oschar *p
   } else if(string_endswith(path, ".desktop")) {
     strncpy_s(result, path, IB_MAX_PATH);
   } else if(strlen(file_type) > 0) {
-    snprintf(result, IB_MAX_PATH, ":filetype:%s", file_type);
+    // files that share a MIME type share an icon.
+    std::string mtype, msubtype;
+    if(FreeDesktopMime::inst() != nullptr && FreeDesktopMime::inst()->findByExtension(mtype, msubtype, file_type)) {
+      snprintf(result, IB_MAX_PATH, ":mime:%s/%s", mtype.c_str(), msubtype.c_str());
+    } else {
+      snprintf(result, IB_MAX_PATH, ":filetype:%s", file_type);
+    }
   } else if(access(path, X_OK) == 0) {
     snprintf(result, IB_MAX_PATH, ":filetype:executable");
   } else {
@@ -1680,6 +2312,55 @@ int ib::platform::file_size(size_t &size, const ib::oschar *path, ib::Error &err
   return 0;
 } // }}}
 
+int ib::platform::rename_file(const ib::oschar *source, const ib::oschar *dest, ib::Error &error){ // {{{
+  if(rename(source, dest) < 0) {
+    set_errno(error);
+    return -1;
+  }
+  return 0;
+} // }}}
+
+int ib::platform::sync_file(std::FILE *fp, ib::Error &error){ // {{{
+  if(fflush(fp) != 0 || fdatasync(fileno(fp)) < 0) {
+    set_errno(error);
+    return -1;
+  }
+  return 0;
+} // }}}
+
+int ib::platform::MappedFile::open(const ib::oschar *path, ib::Error &error){ // {{{
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if(fd < 0) {
+    set_errno(error);
+    return -1;
+  }
+  struct stat st;
+  if(fstat(fd, &st) < 0) {
+    set_errno(error);
+    ::close(fd);
+    return -1;
+  }
+  if(st.st_size > 0) {
+    auto data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+      set_errno(error);
+      ::close(fd);
+      return -1;
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = (size_t)st.st_size;
+  }
+  ::close(fd);
+  return 0;
+} // }}}
+
+void ib::platform::MappedFile::close(){ // {{{
+  if(data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+} // }}}
+
 ib::oschar* ib::platform::file_type(ib::oschar *result, const ib::oschar *path){ // {{{
   if(result == nullptr){ result = new ib::oschar[IB_MAX_PATH]; }
   memset(result, 0, IB_MAX_PATH);
@@ -5,10 +5,13 @@
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <dlfcn.h>
 #include <signal.h>
 #include <pthread.h>
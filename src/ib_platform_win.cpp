@@ -992,7 +992,19 @@ int ib::platform::shell_execute(const std::string &path, const std::vector<std::
   return shell_execute_(path, strparams, cwd, terminal, sudo, error);
 } /* }}} */
 
-int ib::platform::command_output(std::string &sstdout, std::string &sstderr, const char *cmd, ib::Error &error) { // {{{
+class StringCommandOutputListener : public ib::platform::CommandOutputListener { // {{{
+  public:
+    StringCommandOutputListener(std::string &sstdout, std::string &sstderr) : sstdout_(sstdout), sstderr_(sstderr) {}
+    void onStdout(const char *data, const std::size_t size) { sstdout_.append(data, size); }
+    void onStderr(const char *data, const std::size_t size) { sstderr_.append(data, size); }
+    void onExit(const int code, const ib::Error &error) {}
+
+  protected:
+    std::string &sstdout_;
+    std::string &sstderr_;
+}; // }}}
+
+static int run_command(const char *cmd, ib::platform::CommandOutputListener &listener, const int timeout, const std::size_t max_size, ib::Error &error) { // {{{
   auto command = ib::platform::utf82oschar(cmd);
   int funcret = 0;
   
@@ -1014,40 +1026,64 @@ int ib::platform::command_output(std::string &sstdout, std::string &sstderr, con
   startup_info.hStdError  = err_write_pipe;
   SetLastError(NO_ERROR);
   if (CreateProcess(0,command.get(),0,0,true,DETACHED_PROCESS, 0, 0, &startup_info, &process_info)) {
-    char buf_stdout[8192], buf_errout[8192];
-    DWORD dstdout = 0, derrout = 0;
+    char buf[8192];
+    HANDLE pipes[2] = {read_pipe, err_read_pipe};
+    const auto started = GetTickCount();
+    std::size_t total = 0;
     DWORD ret;
   
+    // drains stdout and stderr at the same time, so the command never
+    // blocks on a full pipe.
     while ( (ret = WaitForSingleObject(process_info.hProcess, 0)) != WAIT_ABANDONED) {
-        memset(buf_stdout, 0, sizeof(buf_stdout));
-        memset(buf_errout, 0, sizeof(buf_errout));
-
-        PeekNamedPipe(read_pipe, 0, 0, 0, &dstdout, 0);
-        if (dstdout > 0) {
-          ReadFile(read_pipe, buf_stdout, sizeof(buf_stdout) - 1, &dstdout, 0);
+        DWORD available = 0, read_bytes = 0, received = 0;
+        for(int i = 0; i < 2 && funcret == 0; i++) {
+          PeekNamedPipe(pipes[i], 0, 0, 0, &available, 0);
+          if (available == 0) continue;
+          if (!ReadFile(pipes[i], buf, sizeof(buf), &read_bytes, 0)) continue;
+          std::size_t size = read_bytes;
+          if(max_size > 0 && total + size > max_size) {
+            size = max_size - total;
+            error.setMessage("Output is too large.");
+            error.setCode(1);
+            funcret = -1;
+          }
+          total += size;
+          received += read_bytes;
+          if(i == 0) {
+            listener.onStdout(buf, size);
+          }else{
+            listener.onStderr(buf, size);
+          }
         }
-  
-        PeekNamedPipe(err_read_pipe, 0, 0, 0, &derrout, 0);
-        if (derrout > 0) {
-          ReadFile(err_read_pipe, buf_errout, sizeof(buf_errout) - 1, &derrout, 0);
+        if(funcret == 0 && timeout > 0 && GetTickCount() - started > (DWORD)timeout) {
+          error.setMessage("Command timed out.");
+          error.setCode(1);
+          funcret = -1;
+        }
+        if(funcret != 0) {
+          TerminateProcess(process_info.hProcess, 1);
+          break;
         }
-        sstdout += buf_stdout;
-        sstderr += buf_errout;
   
         MSG msg;
         if (PeekMessage(&msg, 0, 0, 0, PM_REMOVE)){
            TranslateMessage(&msg);
            DispatchMessage(&msg);
         }
-        if (ret == WAIT_OBJECT_0) break;
+        if (received == 0) {
+          if (ret == WAIT_OBJECT_0) break;
+          Sleep(1);
+        }
     }
   
-    DWORD res;
-    GetExitCodeProcess(process_info.hProcess, &res);
-    if(res != 0) {
-      error.setMessage("Command failed.");
-      error.setCode(1);
-      funcret = res;
+    if(funcret == 0) {
+      DWORD res;
+      GetExitCodeProcess(process_info.hProcess, &res);
+      if(res != 0) {
+        error.setMessage("Command failed.");
+        error.setCode(1);
+        funcret = res;
+      }
     }
     CloseHandle(process_info.hProcess);
     CloseHandle(process_info.hThread);
@@ -1064,6 +1100,96 @@ int ib::platform::command_output(std::string &sstdout, std::string &sstderr, con
   return funcret;
 } // }}}
 
+int ib::platform::command_output(std::string &sstdout, std::string &sstderr, const char *cmd, ib::Error &error) { // {{{
+  return ib::platform::command_output(sstdout, sstderr, cmd, 0, 0, error);
+} // }}}
+
+int ib::platform::command_output(std::string &sstdout, std::string &sstderr, const char *cmd, const int timeout, const std::size_t max_size, ib::Error &error) { // {{{
+  StringCommandOutputListener listener(sstdout, sstderr);
+  return run_command(cmd, listener, timeout, max_size, error);
+} // }}}
+
+// command_output_async {{{
+// Outputs are read in a worker thread and passed to the main thread with Fl::awake.
+class AsyncCommandOutputMessage : private ib::NonCopyable<AsyncCommandOutputMessage> { // {{{
+  public:
+    static const int STDOUT = 0;
+    static const int STDERR = 1;
+    static const int EXIT   = 2;
+
+    AsyncCommandOutputMessage(ib::platform::CommandOutputListener *listener, const int type, const char *data, const std::size_t size) : listener_(listener), type_(type), data_(data, size), code_(0), error_() {}
+
+    static void deliver(void *p) {
+      auto self = reinterpret_cast<AsyncCommandOutputMessage*>(p);
+      switch(self->type_) {
+        case STDOUT:
+          self->listener_->onStdout(self->data_.data(), self->data_.size());
+          break;
+        case STDERR:
+          self->listener_->onStderr(self->data_.data(), self->data_.size());
+          break;
+        default:
+          self->listener_->onExit(self->code_, self->error_);
+          delete self->listener_;
+      }
+      delete self;
+    }
+
+    void setExit(const int code, const ib::Error &error) {
+      code_ = code;
+      error_.setCode(error.getCode());
+      error_.setMessage(error.getMessage());
+    }
+
+  protected:
+    ib::platform::CommandOutputListener *listener_;
+    int type_;
+    std::string data_;
+    int code_;
+    ib::Error error_;
+}; // }}}
+
+class AsyncCommandOutput : public ib::platform::CommandOutputListener { // {{{
+  public:
+    AsyncCommandOutput(const char *cmd, ib::platform::CommandOutputListener *listener, const int timeout, const std::size_t max_size) : command_(cmd), listener_(listener), timeout_(timeout), max_size_(max_size) {}
+
+    void onStdout(const char *data, const std::size_t size) {
+      Fl::awake(AsyncCommandOutputMessage::deliver, new AsyncCommandOutputMessage(listener_, AsyncCommandOutputMessage::STDOUT, data, size));
+    }
+    void onStderr(const char *data, const std::size_t size) {
+      Fl::awake(AsyncCommandOutputMessage::deliver, new AsyncCommandOutputMessage(listener_, AsyncCommandOutputMessage::STDERR, data, size));
+    }
+    void onExit(const int code, const ib::Error &error) {
+      auto message = new AsyncCommandOutputMessage(listener_, AsyncCommandOutputMessage::EXIT, "", 0);
+      message->setExit(code, error);
+      Fl::awake(AsyncCommandOutputMessage::deliver, message);
+    }
+
+    static ib::threadret run(void *p) {
+      auto self = reinterpret_cast<AsyncCommandOutput*>(p);
+      ib::platform::on_thread_start();
+      ib::Error error;
+      const auto code = run_command(self->command_.c_str(), *self, self->timeout_, self->max_size_, error);
+      self->onExit(code, error);
+      delete self;
+      ib::platform::exit_thread(0);
+      return (ib::threadret)0;
+    }
+
+  protected:
+    std::string command_;
+    ib::platform::CommandOutputListener *listener_;
+    int timeout_;
+    std::size_t max_size_;
+}; // }}}
+
+int ib::platform::command_output_async(const char *cmd, ib::platform::CommandOutputListener *listener, const int timeout, const std::size_t max_size, ib::Error &error) {
+  ib::thread thread;
+  ib::platform::create_thread(&thread, AsyncCommandOutput::run, new AsyncCommandOutput(cmd, listener, timeout, max_size));
+  return 0;
+}
+// }}}
+
 int ib::platform::show_context_menu(ib::oschar *path){ // {{{
   HRESULT             ret;
   POINT               pt;
@@ -1666,6 +1792,69 @@ int ib::platform::file_size(size_t &size, const ib::oschar *path, ib::Error &err
   return 0;
 } // }}}
 
+int ib::platform::rename_file(const ib::oschar *source, const ib::oschar *dest, ib::Error &error){ // {{{
+  SetLastError(NO_ERROR);
+  auto ret = MoveFileEx(source, dest, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  if(ret == 0){
+    set_winapi_error(error);
+    return 1;
+  };
+  return 0;
+} // }}}
+
+int ib::platform::sync_file(std::FILE *fp, ib::Error &error){ // {{{
+  SetLastError(NO_ERROR);
+  if(fflush(fp) != 0 || FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(fp))) == 0){
+    set_winapi_error(error);
+    return 1;
+  };
+  return 0;
+} // }}}
+
+int ib::platform::MappedFile::open(const ib::oschar *path, ib::Error &error){ // {{{
+  close();
+  SetLastError(NO_ERROR);
+  HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE){
+    set_winapi_error(error);
+    return 1;
+  }
+  LARGE_INTEGER size;
+  if(GetFileSizeEx(file, &size) == 0){
+    set_winapi_error(error);
+    CloseHandle(file);
+    return 1;
+  }
+  if(size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr){
+      set_winapi_error(error);
+      CloseHandle(file);
+      return 1;
+    }
+    auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(data == nullptr){
+      set_winapi_error(error);
+      CloseHandle(mapping);
+      CloseHandle(file);
+      return 1;
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = (std::size_t)size.QuadPart;
+    handle_ = mapping;
+  }
+  CloseHandle(file);
+  return 0;
+} // }}}
+
+void ib::platform::MappedFile::close(){ // {{{
+  if(data_ != nullptr) UnmapViewOfFile(data_);
+  if(handle_ != nullptr) CloseHandle((HANDLE)handle_);
+  data_ = nullptr;
+  size_ = 0;
+  handle_ = nullptr;
+} // }}}
+
 ib::oschar* ib::platform::file_type(ib::oschar *result, const ib::oschar *path){ // {{{
   if(result == nullptr){ result = new ib::oschar[IB_MAX_PATH]; }
   ib::oschar tmp[IB_MAX_PATH];
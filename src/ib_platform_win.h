@@ -8,6 +8,7 @@
 #include <Winuser.h>
 #include <tchar.h>
 #include <process.h>
+#include <io.h>
 #include <shellapi.h>
 #include <shlwapi.h>
 #include <shlobj.h>
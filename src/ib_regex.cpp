@@ -1,5 +1,114 @@
 #include "ib_regex.h"
 
+// class RegexCache {{{
+int ib::RegexCache::get(std::shared_ptr<regex_t> &result, const char *pattern, const unsigned int flags, std::string *error_msg) { // {{{
+  auto &cache = instance();
+  std::string key(pattern);
+  key += '\0';
+  key += std::to_string(flags);
+
+  {
+    ib::platform::ScopedLock lock(&cache.mutex_);
+    auto it = cache.entries_.find(key);
+    if(it != cache.entries_.end()) {
+      cache.lru_.splice(cache.lru_.begin(), cache.lru_, (*it).second.second);
+      result = (*it).second.first;
+      return 0;
+    }
+  }
+
+  // compiles without the lock.
+  std::shared_ptr<regex_t> compiled;
+  const int r = compile(compiled, pattern, flags, error_msg);
+  if (r != 0) {
+    return r;
+  }
+
+  std::shared_ptr<regex_t> evicted;
+  ib::platform::ScopedLock lock(&cache.mutex_);
+  auto it = cache.entries_.find(key);
+  if(it != cache.entries_.end()) {
+    // another thread has compiled the same pattern
+    result = (*it).second.first;
+    return 0;
+  }
+  if(cache.entries_.size() >= CAPACITY) {
+    auto last = cache.entries_.find(cache.lru_.back());
+    evicted.swap((*last).second.first);
+    cache.entries_.erase(last);
+    cache.lru_.pop_back();
+  }
+  cache.lru_.push_front(key);
+  cache.entries_[key] = std::make_pair(compiled, cache.lru_.begin());
+  result = compiled;
+  return 0;
+} // }}}
+
+int ib::RegexCache::compile(std::shared_ptr<regex_t> &result, const char *pattern, const unsigned int flags, std::string *error_msg) { // {{{
+  // onig_new is thread safe after onig_initialize.
+  regex_t *reg = nullptr;
+  OnigErrorInfo error_info;
+  const auto upattern = reinterpret_cast<const unsigned char*>(pattern);
+  int r = onig_new(&reg, upattern, upattern + strlen(pattern),
+    flags, ONIG_ENCODING_UTF8, ONIG_SYNTAX_PERL_NG, &error_info);
+  if (r != ONIG_NORMAL) {
+    if(error_msg != 0){
+      char s[ONIG_MAX_ERROR_MESSAGE_LEN];
+      onig_error_code_to_str((unsigned char*)s, r, &error_info);
+      *error_msg += s;
+    }
+    return r;
+  }
+  // the last Regex that refers to the pattern frees it.
+  result = std::shared_ptr<regex_t>(reg, onig_free);
+  return 0;
+} // }}}
+
+void ib::RegexCache::clear() { // {{{
+  auto &cache = instance();
+  ib::platform::ScopedLock lock(&cache.mutex_);
+  cache.entries_.clear();
+  cache.lru_.clear();
+} // }}}
+
+std::size_t ib::RegexCache::size() { // {{{
+  auto &cache = instance();
+  ib::platform::ScopedLock lock(&cache.mutex_);
+  return cache.entries_.size();
+} // }}}
+// }}}
+
+// class RegexRegionPool {{{
+class RegexRegionList { // {{{
+  public:
+    RegexRegionList() : regions_() {}
+    ~RegexRegionList() {
+      for(auto &region : regions_) { onig_region_free(region, 1); }
+    }
+    std::vector<OnigRegion*> regions_;
+}; // }}}
+
+static thread_local RegexRegionList ib_g_regex_regions;
+
+OnigRegion* ib::RegexRegionPool::acquire() { // {{{
+  auto &regions = ib_g_regex_regions.regions_;
+  if(regions.empty()) return onig_region_new();
+  auto region = regions.back();
+  regions.pop_back();
+  return region;
+} // }}}
+
+void ib::RegexRegionPool::release(OnigRegion *region) { // {{{
+  auto &regions = ib_g_regex_regions.regions_;
+  if(regions.size() >= MAX_SPARES) {
+    onig_region_free(region, 1);
+    return;
+  }
+  onig_region_clear(region);
+  regions.push_back(region);
+} // }}}
+// }}}
+
 std::string ib::Regex::escape(const char*str) { // {{{
   ib::Regex esc("([\\^\\.\\$\\|\\(\\)\\[\\]\\*\\+\\?\\/\\\\])", ib::Regex::NONE);
   esc.init();
@@ -17,7 +126,7 @@ int ib::Regex::match(const char *str, const std::size_t startpos, const std::siz
 
   const auto end   = reinterpret_cast<const unsigned char*>(str + endposs);
   const auto start = reinterpret_cast<const unsigned char*>(str + startposs);
-  last_result_ = onig_match(reg_, (unsigned char*)str, end, start, region_, ONIG_OPTION_NONE);
+  last_result_ = onig_match(reg_.get(), (unsigned char*)str, end, start, region_, ONIG_OPTION_NONE);
   if (last_result_ >= 0) {
     return 0;
   }else{
@@ -36,7 +145,7 @@ int ib::Regex::search(const char *str, const std::size_t startpos, const std::si
   const auto end   = reinterpret_cast<const unsigned char*>(str + endposs);
   const auto start = reinterpret_cast<const unsigned char*>(str + startposs);
   const auto range = end;
-  last_result_ = onig_search(reg_, (unsigned char*)str, end, start, range, region_, ONIG_OPTION_NONE);
+  last_result_ = onig_search(reg_.get(), (unsigned char*)str, end, start, range, region_, ONIG_OPTION_NONE);
   if (last_result_ >= 0) {
     return 0;
   }else{
@@ -11,15 +11,54 @@ namespace ib{
 
   class OnigrumaService {
     public:
-      static ib::mutex* getMutex() { 
-        static ib::mutex mutex;
-        return &mutex; 
-      }
+      // must be called before any other threads use Oniguruma.
       static void init() {
-        ib::platform::create_mutex(getMutex());
+        OnigEncoding encodings[] = {ONIG_ENCODING_UTF8};
+        onig_initialize(encodings, sizeof(encodings)/sizeof(encodings[0]));
+        onig_set_default_case_fold_flag(0);
       }
   };
 
+  // Compiled patterns shared by all Regex objects, keyed by (pattern, flags).
+  // Compiled patterns are never modified after compilation, so they can be
+  // used by multiple threads without locks. The mutex guards only the table.
+  class RegexCache : private NonCopyable<RegexCache> { // {{{
+    public:
+      static const std::size_t CAPACITY = 256;
+
+      static int get(std::shared_ptr<regex_t> &result, const char *pattern, const unsigned int flags, std::string *error_msg = 0);
+      // compiles the pattern without adding it to the cache.
+      static int compile(std::shared_ptr<regex_t> &result, const char *pattern, const unsigned int flags, std::string *error_msg = 0);
+      static void clear();
+      static std::size_t size();
+
+    protected:
+      RegexCache() : mutex_(), entries_(), lru_() {
+        ib::platform::create_mutex(&mutex_);
+      }
+      ~RegexCache() {
+        ib::platform::destroy_mutex(&mutex_);
+      }
+      static RegexCache& instance() {
+        static RegexCache cache;
+        return cache;
+      }
+
+      typedef std::list<std::string> lru_list;
+      ib::mutex mutex_;
+      std::unordered_map<std::string, std::pair<std::shared_ptr<regex_t>, lru_list::iterator>> entries_;
+      lru_list lru_;
+  }; // }}}
+
+  // Match regions are reused within a thread.
+  class RegexRegionPool { // {{{
+    public:
+      static const std::size_t MAX_SPARES = 16;
+
+      static OnigRegion* acquire();
+      static void release(OnigRegion *region);
+  }; // }}}
+
   class Regex : private NonCopyable<Regex> {
     public:
       const static unsigned int NONE = ONIG_OPTION_NONE;
@@ -32,7 +71,9 @@ namespace ib{
         return escape(str.c_str());
       };
 
-      Regex(const char *pattern, unsigned int flags) : pattern_(nullptr), flags_(flags), reg_(nullptr), error_info_(), region_(nullptr), const_string_(nullptr), var_string_(nullptr), var_string_alloced_(false), last_result_(-1), sub_meta_char_('\\') {
+      // patterns that are built for a single use(e.g. migemo queries)
+      // should not be cached, or they push out reused patterns.
+      Regex(const char *pattern, unsigned int flags, const bool is_cached = true) : pattern_(nullptr), flags_(flags), is_cached_(is_cached), reg_(), region_(nullptr), const_string_(nullptr), var_string_(nullptr), var_string_alloced_(false), last_result_(-1), sub_meta_char_('\\') {
         size_t len = strlen(pattern) + 1;
         char *tmpptr = (char*)malloc(sizeof(char) * len);
         strcpy(tmpptr, pattern);
@@ -41,32 +82,22 @@ namespace ib{
       }
 
       int init(std::string *error_msg = 0) {
-        ib::platform::ScopedLock lock(OnigrumaService::getMutex());
-        if(reg_ == 0){
-          region_  = onig_region_new();
-          onig_set_default_case_fold_flag(0);
-          int r = onig_new(&reg_, pattern_, pattern_ + strlen((char* )pattern_),
-            flags_, ONIG_ENCODING_UTF8, ONIG_SYNTAX_PERL_NG, &error_info_);
-          if (r != ONIG_NORMAL) {
-            if(error_msg != 0){
-              char s[ONIG_MAX_ERROR_MESSAGE_LEN];
-              onig_error_code_to_str((unsigned char*)s, r, &error_info_);
-              *error_msg += s;
-            }
-            return r;
-          }
-          return 0;
-        }else{
+        if(reg_){
           return 0;
         }
+        const int r = is_cached_ ? RegexCache::get(reg_, (const char*)pattern_, flags_, error_msg) :
+                                   RegexCache::compile(reg_, (const char*)pattern_, flags_, error_msg);
+        if (r != 0) {
+          return r;
+        }
+        region_ = RegexRegionPool::acquire();
+        return 0;
       }
 
       ~Regex() {
-        ib::platform::ScopedLock lock(OnigrumaService::getMutex());
         freeString();
         free(pattern_);
-        if(reg_ != 0){ onig_free(reg_); }
-        if(region_ != 0) { onig_region_free(region_, 1); }
+        if(region_ != 0) { RegexRegionPool::release(region_); }
       }
 
       const char* getPattern() const { return (const char*)pattern_;}
@@ -145,8 +176,8 @@ namespace ib{
     protected:
       unsigned char  *pattern_;
       unsigned int flags_;
-      regex_t* reg_;
-      OnigErrorInfo error_info_;
+      bool is_cached_;
+      std::shared_ptr<regex_t> reg_;
       OnigRegion *region_;
       const char *const_string_;
       char       *var_string_;
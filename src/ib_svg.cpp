@@ -6,23 +6,93 @@
 #define NANOSVGRAST_IMPLEMENTATION
 #include "nanosvgrast.h"
 
-
-unsigned char* ib::rasterize_svg_file(const char *path, int size) {
-  unsigned char *result = nullptr;
-  NSVGimage *svg_image = nullptr;
-  NSVGrasterizer *rasterizer= nullptr;
-  double scale;
-
-  svg_image = nsvgParseFromFile(path, "px", 96.0f);
-  if(svg_image == 0) goto finally;
-  rasterizer = nsvgCreateRasterizer();
-  if(rasterizer == 0) goto finally;
-
-  scale = (double)size / (double)svg_image->width;
-  result = new unsigned char[size * size * 4];
+static unsigned char* rasterize_svg_image(NSVGrasterizer *rasterizer, NSVGimage *svg_image, const int size) {
+  const double scale = (double)size / (double)svg_image->width;
+  auto result = new unsigned char[size * size * 4];
   nsvgRasterize(rasterizer, svg_image, 0, 0, scale, result, size, size, size*4);
-finally:
-  if(rasterizer != nullptr) nsvgDeleteRasterizer(rasterizer);
-  if(svg_image != nullptr) nsvgDelete(svg_image);
   return result;
 }
+
+// an approximate number of bytes that nanosvg allocates for the image.
+static std::size_t estimate_svg_bytes(const NSVGimage *svg_image) {
+  std::size_t bytes = sizeof(NSVGimage);
+  for(auto shape = svg_image->shapes; shape != nullptr; shape = shape->next) {
+    bytes += sizeof(NSVGshape);
+    const NSVGpaint *paints[] = {&shape->fill, &shape->stroke};
+    for(auto paint : paints) {
+      if(paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT) {
+        bytes += sizeof(NSVGgradient) + sizeof(NSVGgradientStop) * paint->gradient->nstops;
+      }
+    }
+    for(auto path = shape->paths; path != nullptr; path = path->next) {
+      bytes += sizeof(NSVGpath) + sizeof(float) * 2 * path->npts;
+    }
+  }
+  return bytes;
+}
+
+// class SvgCache {{{
+const std::size_t ib::SvgCache::MAX_BYTES;
+
+void ib::SvgCache::rasterize(const char *path, const std::vector<int> &sizes, std::vector<unsigned char*> &results) { // {{{
+  results.assign(sizes.size(), nullptr);
+  auto svg_image = getImage(path);
+  if(svg_image == nullptr) return;
+  auto rasterizer = nsvgCreateRasterizer();
+  if(rasterizer == nullptr) return;
+  for(std::size_t i = 0; i < sizes.size(); ++i) {
+    results[i] = rasterize_svg_image(rasterizer, svg_image.get(), sizes[i]);
+  }
+  nsvgDeleteRasterizer(rasterizer);
+} // }}}
+
+void ib::SvgCache::clear() { // {{{
+  ib::platform::ScopedLock lock(&mutex_);
+  images_.clear();
+  lru_.clear();
+  bytes_ = 0;
+} // }}}
+
+// Images are shared with threads that are rasterizing them, so evicting
+// an image does not free it while it is in use.
+std::shared_ptr<NSVGimage> ib::SvgCache::getImage(const char *path) { // {{{
+  const std::string key(path);
+  {
+    ib::platform::ScopedLock lock(&mutex_);
+    auto it = images_.find(key);
+    if(it != images_.end()) {
+      lru_.splice(lru_.begin(), lru_, (*it).second.lru);
+      return (*it).second.image;
+    }
+  }
+
+  auto lopath = ib::platform::utf82local(path);
+  auto parsed = nsvgParseFromFile(lopath.get(), "px", 96.0f);
+  if(parsed == nullptr) return nullptr;
+  if(parsed->width <= 0.0f) {
+    nsvgDelete(parsed);
+    return nullptr;
+  }
+  const auto bytes = estimate_svg_bytes(parsed);
+  std::shared_ptr<NSVGimage> svg_image(parsed, nsvgDelete);
+  if(bytes > MAX_BYTES) return svg_image;
+
+  ib::platform::ScopedLock lock(&mutex_);
+  auto it = images_.find(key);
+  if(it != images_.end()) {
+    // another thread has parsed the file while this thread was parsing it.
+    return (*it).second.image;
+  }
+  while(!lru_.empty() && bytes_ + bytes > MAX_BYTES) {
+    auto evicted = images_.find(lru_.back());
+    bytes_ -= (*evicted).second.bytes;
+    images_.erase(evicted);
+    lru_.pop_back();
+  }
+  lru_.push_front(key);
+  Entry entry = {svg_image, bytes, lru_.begin()};
+  images_[key] = entry;
+  bytes_ += bytes;
+  return svg_image;
+} // }}}
+// }}}
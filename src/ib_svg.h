@@ -5,8 +5,48 @@
 #include "ib_utils.h"
 #include "ib_platform.h"
 
+struct NSVGimage;
+
 namespace ib{
-  unsigned char* rasterize_svg_file(const char *path, int size);
+  // Parsed SVG files, so that an icon can be rasterized in other sizes
+  // without parsing the file again. Files are evicted in least recently
+  // used order when their estimated memory exceeds MAX_BYTES.
+  class SvgCache : private NonCopyable<SvgCache> { // {{{
+    public:
+      static const std::size_t MAX_BYTES = 4 * 1024 * 1024;
+
+      SvgCache() : mutex_(), images_(), lru_(), bytes_(0) {
+        ib::platform::create_mutex(&mutex_);
+      }
+      ~SvgCache() {
+        clear();
+        ib::platform::destroy_mutex(&mutex_);
+      }
+
+      // rasterizes the file in each of the sizes with one rasterizer.
+      // results[i] is a RGBA buffer of sizes[i] x sizes[i] pixels that the
+      // caller owns, or nullptr if the file can not be parsed.
+      void rasterize(const char *path, const std::vector<int> &sizes, std::vector<unsigned char*> &results);
+      void clear();
+      std::size_t getBytes() const { return bytes_; }
+
+    protected:
+      struct Entry {
+        std::shared_ptr<NSVGimage> image;
+        std::size_t bytes;
+        std::list<std::string>::iterator lru;
+      };
+
+      std::shared_ptr<NSVGimage> getImage(const char *path);
+
+      // guards the members below. Files are never parsed or rasterized
+      // with this lock held.
+      ib::mutex mutex_;
+      std::unordered_map<std::string, Entry> images_;
+      // paths in the most recently used order
+      std::list<std::string> lru_;
+      std::size_t bytes_;
+  }; // }}}
 }
 
 
@@ -5,6 +5,7 @@
 #include "ib_controller.h"
 #include "ib_comp_value.h"
 #include "ib_icon_manager.h"
+#include "ib_history.h"
 #include "ib_singleton.h"
 
 // class Input {{{
@@ -78,6 +79,8 @@ int ib::Input::handle(int e){ /* {{{ */
   const auto mods = state & (FL_META|FL_CTRL|FL_ALT);
   const auto shift = state & FL_SHIFT;
   const auto selected = (position() != mark()) ? 1 : 0;
+  const ib::KeyBinding *binding = nullptr;
+  int action = ib::KeyBindings::NONE;
 
   switch(e){
     case FL_KEYUP:
@@ -86,17 +89,20 @@ int ib::Input::handle(int e){ /* {{{ */
 keyup:
         // ignore shift key up
         if(key == 65505 && state == 0) { return 1; }
+        action = cfg->getKeyBindings().findAction(key, state);
         // ignore hot key
-        if(ib::utils::matches_key(cfg->getHotKey(), key, state)) { return 1;}
+        if(action == ib::KeyBindings::HOT_KEY) { return 1;}
         // calls an event handler
-        lua_getglobal(IB_LUA, "on_key_up");
-        if (lua_pcall(IB_LUA, 0, 1, 0)) {
-            ib::utils::message_box("%s", lua_tostring(IB_LUA, lua_gettop(IB_LUA)));
-            return 1;
+        if(cfg->getEnableKeyUpHandler()) {
+          lua_getglobal(IB_LUA, "on_key_up");
+          if (lua_pcall(IB_LUA, 0, 1, 0)) {
+              ib::utils::message_box("%s", lua_tostring(IB_LUA, lua_gettop(IB_LUA)));
+              return 1;
+          }
+          accept = (int)lua_tonumber(IB_LUA, 1);
+          ib::Singleton<ib::MainLuaState>::getInstance()->clearStack();
+          if(accept) { return 1; }
         }
-        accept = (int)lua_tonumber(IB_LUA, 1);
-        ib::Singleton<ib::MainLuaState>::getInstance()->clearStack();
-        if(accept) { return 1; }
         if(
            // paste
            (key == FL_Insert && mods==0 && shift) ||
@@ -105,16 +111,16 @@ keyup:
            //(mods == 0 && shift && selected) ||
            (key == 'x' && mods==FL_COMMAND) ||
            // kill word
-           ib::utils::matches_key(cfg->getKillWordKey(), key, state)
+           action == ib::KeyBindings::KILL_WORD
            ){
           key_event_.cancelEvent();
           controller->showCompletionCandidates();
           return 1;
         }
 
-        if(ib::utils::matches_key(cfg->getListNextKey(), key, state) ||
-           ib::utils::matches_key(cfg->getListPrevKey(), key, state) || 
-           ib::utils::matches_key(cfg->getToggleModeKey(), key, state) ||
+        if(action == ib::KeyBindings::LIST_NEXT ||
+           action == ib::KeyBindings::LIST_PREV || 
+           action == ib::KeyBindings::TOGGLE_MODE ||
            key == FL_Enter
             ){
           key_event_.cancelEvent();
@@ -137,17 +143,25 @@ keyup:
       if(!getImeComposition() && key != 0xe5 && key != 0xfee9){
         // ignore shift key down
         if(key == 65505 && state == 0) { return 1; }
+        binding = cfg->getKeyBindings().find(key, state);
+        action = binding == nullptr ? ib::KeyBindings::NONE : binding->getAction();
         // ignore hot key
-        if(ib::utils::matches_key(cfg->getHotKey(), key, state)) { return 1;}
+        if(action == ib::KeyBindings::HOT_KEY) { return 1;}
         // calls an event handler
-        lua_getglobal(IB_LUA, "on_key_down");
-        if (lua_pcall(IB_LUA, 0, 1, 0)) {
-            ib::utils::message_box("%s", lua_tostring(IB_LUA, lua_gettop(IB_LUA)));
-            return 1;
+        if(cfg->getEnableKeyDownHandler()) {
+          lua_getglobal(IB_LUA, "on_key_down");
+          if (lua_pcall(IB_LUA, 0, 1, 0)) {
+              ib::utils::message_box("%s", lua_tostring(IB_LUA, lua_gettop(IB_LUA)));
+              return 1;
+          }
+          accept = (int)lua_tonumber(IB_LUA, 1);
+          ib::Singleton<ib::MainLuaState>::getInstance()->clearStack();
+          if(accept) { return 1; }
+        }
+        if(action == ib::KeyBindings::SHORTCUT){
+          controller->executeShortcut(binding->getCommand());
+          return 1;
         }
-        accept = (int)lua_tonumber(IB_LUA, 1);
-        ib::Singleton<ib::MainLuaState>::getInstance()->clearStack();
-        if(accept) { return 1; }
         // handle copy&paste events
         if(
            // paste
@@ -176,25 +190,22 @@ keyup:
           }
           return 1;
         }
-        if(ib::utils::matches_key(cfg->getEscapeKey(), key, state)){
-          controller->hideApplication();
-          return 1;
-        }
-        if(ib::utils::matches_key(cfg->getListNextKey(), key, state)){
-          controller->selectNextCompletion();
-          return 1;
-        }
-        if(ib::utils::matches_key(cfg->getListPrevKey(), key, state)){
-          controller->selectPrevCompletion();
-          return 1;
-        }
-        if(ib::utils::matches_key(cfg->getToggleModeKey(), key, state)){
-          controller->toggleHistorySearchMode();
-          return 1;
-        }
-        if(ib::utils::matches_key(cfg->getKillWordKey(), key, state)){
-          controller->killWord();
-          return 1;
+        switch(action){
+          case ib::KeyBindings::ESCAPE:
+            controller->hideApplication();
+            return 1;
+          case ib::KeyBindings::LIST_NEXT:
+            controller->selectNextCompletion();
+            return 1;
+          case ib::KeyBindings::LIST_PREV:
+            controller->selectPrevCompletion();
+            return 1;
+          case ib::KeyBindings::TOGGLE_MODE:
+            controller->toggleHistorySearchMode();
+            return 1;
+          case ib::KeyBindings::KILL_WORD:
+            controller->killWord();
+            return 1;
         }
       }
       Fl_Input::handle(e);
@@ -229,9 +240,9 @@ keyup:
 
 void ib::Input::scan() { // {{{
   // copy the value(not reference)
-  prev_cursor_value_ = getCursorToken()->getValue();
-  lexer_.clear();
-  lexer_.parse(value());
+  const auto cursor_value = getCursorToken()->getValue();
+  prev_cursor_value_.assign(cursor_value.data(), cursor_value.size());
+  lexer_.update(value());
 
   // set the cursor_token
   auto cursor_pos = static_cast<unsigned int>(position());
@@ -298,8 +309,8 @@ const ib::Token* ib::Input::getCursorToken() const { // {{{
   return lexer_.getTokens().at(cursor_token_index_);
 } // }}}
 
-const std::string& ib::Input::getCursorValue() const { // {{{
-  return getCursorToken()->getValue();
+std::string ib::Input::getCursorValue() const { // {{{
+  return getCursorToken()->getValue().str();
 } // }}}
 
 void ib::Input::draw() { // {{{
@@ -362,16 +373,18 @@ void ib::MainWindow::close() { // {{{
 
 void ib::MainWindow::clearIconbox() { // {{{
   if(!ib::Singleton<ib::Config>::getInstance()->getEnableIcons()) return;
-  auto image = iconbox_->image();
-  if(image) delete image;
+  ib::Singleton<ib::IconManager>::getInstance()->releaseIcon(iconbox_->image());
   iconbox_->image(ib::Singleton<ib::IconManager>::getInstance()->getEmptyIcon(IB_ICON_SIZE_LARGE,IB_ICON_SIZE_LARGE));
   redraw();
 } // }}}
 
 void ib::MainWindow::setIconbox(Fl_Image *image) { // {{{
-  if(!ib::Singleton<ib::Config>::getInstance()->getEnableIcons()) return;
-  auto bimage = iconbox_->image();
-  if(bimage) delete bimage;
+  const auto icon_manager = ib::Singleton<ib::IconManager>::getInstance();
+  if(!ib::Singleton<ib::Config>::getInstance()->getEnableIcons()) {
+    icon_manager->releaseIcon(image);
+    return;
+  }
+  icon_manager->releaseIcon(iconbox_->image());
   iconbox_->image(image);
   redraw();
 }
@@ -472,6 +485,20 @@ void ib::Listbox::item_draw (void *item, int X, int Y, int W, int H) const { //
   }
 } // }}}
 
+void ib::Listbox::draw() { // {{{
+  Fl_Select_Browser::draw();
+  // icons near the visible lines are loaded first.
+  int first, last;
+  getVisibleLines(first, last);
+  ib::Singleton<ib::IconManager>::getInstance()->getLoader().setViewport(first, last, value());
+} // }}}
+
+void ib::Listbox::getVisibleLines(int &first, int &last) const { // {{{
+  first = std::max<int>(topline(), 1);
+  last = first;
+  while(last < size() && displayed(last+1)) { ++last; }
+} // }}}
+
 int ib::Listbox::item_height(void *item) const { // {{{
   auto l = reinterpret_cast<FL_BLINE*>(item);
   const auto str = l->txt;
@@ -568,6 +595,7 @@ void ib::Listbox::addValue(ib::CompletionValue* value){ // {{{
 void ib::Listbox::removeValue(int line){ // {{{
   ib::platform::ScopedLock lock(&mutex_);
   incOperationCount();
+  ib::Singleton<ib::IconManager>::getInstance()->getLoader().clear();
   destroyIcon(line);
   remove(line);
   values_.erase(values_.begin() + line -1);
@@ -580,6 +608,7 @@ ib::CompletionValue* ib::Listbox::selectedValue() const { // {{{
 void ib::Listbox::clearAll(){ // {{{
   ib::platform::ScopedLock lock(&mutex_);
   incOperationCount();
+  ib::Singleton<ib::IconManager>::getInstance()->getLoader().clear();
   const auto main_window = ib::Singleton<ib::MainWindow>::getInstance();
 
   if(main_window->getInput()->getCursorTokenIndex() == 0) {
@@ -591,6 +620,7 @@ void ib::Listbox::clearAll(){ // {{{
   }
   values_.clear();
   std::vector<ib::CompletionValue*>().swap (values_);
+  ib::Singleton<ib::History>::getInstance()->freeRetiredCommands();
   is_autocompleted_ = false;
   max_width_ = 0;
   clear();
@@ -603,7 +633,7 @@ void ib::Listbox::destroyIcon(const int line){ // {{{
 
   remove_icon(line);
   icon(line, nullptr);
-  delete image_icon;
+  ib::Singleton<ib::IconManager>::getInstance()->releaseIcon(image_icon);
 } // }}}
 
 void ib::Listbox::startUpdate(){ /* {{{ */
@@ -36,12 +36,12 @@ namespace ib {
       const char* getValue() const { return value();}
       void setValue(const char* val) { value(val); scan();}
       const ib::Token* getCursorToken() const;
-      const std::string& getCursorValue() const;
+      std::string getCursorValue() const;
       int getCursorTokenIndex() const { return cursor_token_index_; }
       int getPrevCursorTokenIndex() const { return prev_cursor_token_index_; }
       const std::vector<ib::Token*>& getTokens() const { return lexer_.getTokens();}
       const std::vector<std::string*>& getParamValues() const { return lexer_.getParamValues();}
-      const std::string& getFirstValue() const { return lexer_.getTokens().at(0)->getValue(); }
+      std::string getFirstValue() const { return lexer_.getFirstValue().str(); }
       const std::string& getPrevCursorValue() const { return prev_cursor_value_; }
       bool isUsingCwd() const { return lexer_.isUsingCwd(); }
       ib::CancelableEvent& getKeyEvent() { return key_event_; }
@@ -124,6 +124,7 @@ namespace ib {
       void selectPrev();
       void selectLine(const int line, const bool move2middle = true);
       void adjustSize();
+      void getVisibleLines(int &first, int &last) const;
 
       ib::mutex* getMutex() { return &mutex_; }
       int getOperationCount() const { return operation_count_; }
@@ -136,6 +137,7 @@ namespace ib {
         ib::platform::create_mutex(&mutex_);
       };
       void item_draw (void *item, int X, int Y, int W, int H) const;
+      void draw();
 
       int max_width_;
       std::vector<ib::CompletionValue*> values_;
@@ -579,7 +579,8 @@ void ib::utils::u32int2bebytes(char *result, ib::u32 value){ // {{{
 } // }}}
 
 ib::u32 ib::utils::bebytes2u32int(const char *bytes){ // {{{
-  return (ib::u32)(((bytes[3] | (bytes[2] << 8)) | (bytes[1] << 0x10)) | (bytes[0] << 0x18));
+  const auto b = reinterpret_cast<const unsigned char*>(bytes);
+  return (ib::u32)(((b[3] | (b[2] << 8)) | (b[1] << 0x10)) | ((ib::u32)b[0] << 0x18));
 } // }}}
 
 void ib::utils::message_box(const char *fmt, ...){ // {{{
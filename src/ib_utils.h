@@ -119,6 +119,73 @@ namespace ib {
     public:
       typedef T Type;
   }; // }}}
+
+  // A non-owning reference to a range of characters.
+  // The data is NOT null terminated.
+  class StringView { // {{{
+    public:
+      StringView() : data_(""), size_(0) {}
+      StringView(const char *data, const std::size_t size) : data_(data), size_(size) {}
+      StringView(const std::string &str) : data_(str.data()), size_(str.size()) {}
+
+      const char* data() const { return data_; }
+      std::size_t size() const { return size_; }
+      std::size_t length() const { return size_; }
+      bool empty() const { return size_ == 0; }
+      char operator[](const std::size_t i) const { return data_[i]; }
+      std::string str() const { return std::string(data_, size_); }
+      bool startsWith(const StringView &prefix) const {
+        return prefix.size_ <= size_ && memcmp(data_, prefix.data_, prefix.size_) == 0;
+      }
+      bool operator==(const StringView &rhs) const {
+        return size_ == rhs.size_ && memcmp(data_, rhs.data_, size_) == 0;
+      }
+      bool operator==(const char *rhs) const { return *this == StringView(rhs, strlen(rhs)); }
+      bool operator!=(const StringView &rhs) const { return !(*this == rhs); }
+      bool operator!=(const char *rhs) const { return !(*this == rhs); }
+
+    protected:
+      const char *data_;
+      std::size_t size_;
+  }; // }}}
+
+  inline std::string& operator+=(std::string &lhs, const StringView &rhs) {
+    return lhs.append(rhs.data(), rhs.size());
+  }
+
+  // A bounded lock-free queue for one producer thread and one consumer thread.
+  template <typename T, std::size_t N>
+  class SpscQueue : private NonCopyable<SpscQueue<T, N> > { // {{{
+    public:
+      SpscQueue() : buffer_(), head_(0), pad_(), tail_(0) {}
+
+      // called by the producer. returns false if the queue is full.
+      bool push(const T &value) {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_.load(std::memory_order_acquire) == N) return false;
+        buffer_[tail % N] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      // called by the consumer. returns false if the queue is empty.
+      bool pop(T &value) {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if(head == tail_.load(std::memory_order_acquire)) return false;
+        value = buffer_[head % N];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+    protected:
+      T buffer_[N];
+      // the producer and the consumer write to different cache lines.
+      // this is padding rather than alignas, since operator new does not
+      // honour extended alignments before C++17.
+      std::atomic<std::size_t> head_;
+      char pad_[64 - sizeof(std::atomic<std::size_t>)];
+      std::atomic<std::size_t> tail_;
+  }; // }}}
   // }}}
 
   class Error : private NonCopyable<Error> { // {{{
@@ -127,9 +127,7 @@ int main(int argc, char **argv) { // {{{
   history->load();
   if(cfg->getEnableIcons()){
     icon_manager->load();
-    auto &event = icon_manager->getLoaderEvent();
-    event.setMs(1);
-    event.startThread();
+    icon_manager->getLoader().startThreads(cfg->getIconLoaderThreads());
   }
 
   auto &event = mainwin->getInput()->getKeyEvent();
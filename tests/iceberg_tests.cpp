@@ -1,7 +1,11 @@
 #include "iceberg_tests.h"
+#include "ib_regex.h"
 #include "test_ib_utils.h"
 #include "test_ib_platform_win.h"
 #include "test_ib_regex.h"
+#include "test_ib_lexer.h"
+#include "test_ib_history.h"
+#include "test_ib_image.h"
 
 // {{{
 void ib::TestCase::run(){
@@ -66,10 +70,14 @@ class AllTests : public ib::TestSuite {
       add(new ib::TestUtils(this));
       add(new ib::TestPlatformWin(this));
       add(new ib::TestRegex(this));
+      add(new ib::TestLexer(this));
+      add(new ib::TestHistory(this));
+      add(new ib::TestImage(this));
     }
 };
 
 int main (int argc, char const* argv[]) {
+  ib::OnigrumaService::init();
   long malloc_count = ib::utils::malloc_count();
   {
     std::unique_ptr<ib::TestReporter> reporter(new ib::SimpleTestReporter());
@@ -0,0 +1,57 @@
+#include "iceberg_tests.h"
+#include "ib_history.h"
+#include "test_ib_history.h"
+
+void test_history_log_record(ib::TestCase *c) {
+  std::string buf;
+  ib::HistoryLog::writeHeader(buf);
+  ib_test_assert(ib::HistoryLog::readHeader(buf.data(), buf.size()), "");
+  ib::HistoryLog::writeRecord(buf, "ls", "ls -l /tmp", (std::time_t)1700000000);
+  ib::HistoryLog::writeRecord(buf, "\xe3\x83\x86", "", (std::time_t)-1);
+
+  const auto end = buf.data() + buf.size();
+  ib::StringView name, path;
+  std::time_t time;
+  auto ptr = ib::HistoryLog::readRecord(buf.data() + ib::HistoryLog::HEADER_SIZE, end, name, path, time);
+  ib_test_assert(ptr != nullptr && name == "ls" && path == "ls -l /tmp" && time == 1700000000, "");
+  ptr = ib::HistoryLog::readRecord(ptr, end, name, path, time);
+  ib_test_assert(ptr == end && name == "\xe3\x83\x86" && path.empty() && time == -1, "");
+
+  // truncated record
+  ptr = ib::HistoryLog::readRecord(buf.data() + ib::HistoryLog::HEADER_SIZE, end - 1, name, path, time);
+  ib_test_assert(ptr != nullptr, "");
+  ib_test_assert(ib::HistoryLog::readRecord(ptr, end - 1, name, path, time) == nullptr, "");
+  // broken record
+  buf[ib::HistoryLog::HEADER_SIZE + ib::HistoryLog::RECORD_HEADER_SIZE] = 'x';
+  ib_test_assert(ib::HistoryLog::readRecord(buf.data() + ib::HistoryLog::HEADER_SIZE, end, name, path, time) == nullptr, "");
+}
+
+void test_history_index(ib::TestCase *c) {
+  ib::HistoryIndex index;
+  ib::HistoryCommand cmd1, cmd2, cmd3;
+  cmd1.setPath("git status");
+  cmd2.setPath("Git Log");
+  cmd3.setPath("grep -r TODO");
+  index.add(&cmd1);
+  index.add(&cmd2);
+  index.add(&cmd3);
+
+  std::vector<ib::HistoryCommand*> result;
+  index.findPrefix(result, "GIT");
+  ib_test_assert(result.size() == 2, "");
+  result.clear();
+  index.findPrefix(result, "g");
+  ib_test_assert(result.size() == 3, "");
+
+  result.clear();
+  ib_test_assert(index.findSubstring(result, "todo") && result.size() == 1 && result.at(0) == &cmd3, "");
+  result.clear();
+  ib_test_assert(!index.findSubstring(result, "lo"), "");
+
+  index.remove(&cmd1);
+  result.clear();
+  index.findPrefix(result, "git ");
+  ib_test_assert(result.size() == 1 && result.at(0) == &cmd2, "");
+  result.clear();
+  ib_test_assert(index.findSubstring(result, "stat") && result.empty(), "");
+}
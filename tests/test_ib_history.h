@@ -0,0 +1,14 @@
+#ifndef __IB_TEST_HISTORY_H__
+#define __IB_TEST_HISTORY_H__
+void test_history_log_record(ib::TestCase *c);
+void test_history_index(ib::TestCase *c);
+
+namespace ib {
+  IB_TESTCASE(History)
+    void build(){
+      add(test_history_log_record);
+      add(test_history_index);
+    }
+  IB_END_TESTCASE;
+}
+#endif
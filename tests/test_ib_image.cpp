@@ -0,0 +1,32 @@
+#include "iceberg_tests.h"
+#include "ib_image.h"
+#include "test_ib_image.h"
+
+void test_resize_image(ib::TestCase *c) {
+  // a solid color stays the same
+  std::vector<unsigned char> solid(48 * 48 * 4);
+  for(std::size_t i = 0; i < solid.size(); i += 4) {
+    solid[i] = 10; solid[i+1] = 200; solid[i+2] = 77; solid[i+3] = 255;
+  }
+  std::vector<unsigned char> dst(32 * 32 * 4);
+  ib::resize_image(dst.data(), 32, 32, solid.data(), 48, 48, 4, 0);
+  ib_test_assert(dst[0] == 10 && dst[1] == 200 && dst[2] == 77 && dst[3] == 255, "");
+  ib_test_assert(memcmp(dst.data(), solid.data(), dst.size()) == 0, "");
+
+  // transparent pixels do not change colors
+  const unsigned char rgba[] = {255,0,0,255, 0,255,0,0, 255,0,0,255, 0,255,0,0};
+  unsigned char pixel[4];
+  ib::resize_image(pixel, 1, 1, rgba, 2, 2, 4, 0);
+  ib_test_assert(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0 && pixel[3] == 128, "");
+
+  // pixels are weighted by the area they cover
+  const unsigned char gray[] = {0, 90, 180};
+  unsigned char two[8];
+  ib::resize_image(two, 2, 1, gray, 3, 1, 1, 0);
+  ib_test_assert(two[0] == 30 && two[4] == 150 && two[3] == 255 && two[7] == 255, "");
+
+  // rows may be padded
+  const unsigned char rgb[] = {10,20,30, 30,40,50, 0,0, 10,20,30, 30,40,50, 0,0};
+  ib::resize_image(pixel, 1, 1, rgb, 2, 2, 3, 8);
+  ib_test_assert(pixel[0] == 20 && pixel[1] == 30 && pixel[2] == 40 && pixel[3] == 255, "");
+}
@@ -0,0 +1,12 @@
+#ifndef __IB_TEST_IMAGE_H__
+#define __IB_TEST_IMAGE_H__
+void test_resize_image(ib::TestCase *c);
+
+namespace ib {
+  IB_TESTCASE(Image)
+    void build(){
+      add(test_resize_image);
+    }
+  IB_END_TESTCASE;
+}
+#endif
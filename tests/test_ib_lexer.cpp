@@ -0,0 +1,41 @@
+#include "iceberg_tests.h"
+#include "ib_lexer.h"
+#include "test_ib_lexer.h"
+
+void test_command_lexer_parse(ib::TestCase *c) {
+  ib::CommandLexer lexer;
+  lexer.parse("!cmd  \"a \\\"b\" c");
+  const auto &tokens = lexer.getTokens();
+  ib_test_assert(lexer.isUsingCwd(), "");
+  ib_test_assert(tokens.size() == 5, "");
+  ib_test_assert(lexer.getFirstValue() == "cmd", "");
+  ib_test_assert(!tokens.at(1)->isValueToken(), "");
+  ib_test_assert(tokens.at(2)->getToken() == "\"a \\\"b\"", "");
+  ib_test_assert(tokens.at(2)->getValue() == "a \"b", "");
+  ib_test_assert(tokens.at(4)->getStartPos() == 14, "");
+
+  const auto &params = lexer.getParamValues();
+  ib_test_assert(params.size() == 2, "");
+  ib_test_assert(*params.at(0) == "a \"b", "");
+  ib_test_assert(*params.at(1) == "c", "");
+}
+
+void test_command_lexer_update(ib::TestCase *c) {
+  const char *inputs[] = {"l", "ls", "ls ", "ls \"", "ls \"a\\\"", "ls \"a\\\"\"", "ls \"a\\\"", "ls", "ls -l", "ps -l", ""};
+  ib::CommandLexer lexer;
+  for(const auto input : inputs){
+    lexer.update(input);
+    ib::CommandLexer expected;
+    expected.parse(input);
+
+    const auto &tokens = lexer.getTokens();
+    const auto &expected_tokens = expected.getTokens();
+    ib_test_assert(tokens.size() == expected_tokens.size(), input);
+    for(std::size_t i = 0; i < tokens.size() && i < expected_tokens.size(); ++i){
+      ib_test_assert(tokens.at(i)->getType() == expected_tokens.at(i)->getType(), input);
+      ib_test_assert(tokens.at(i)->getStartPos() == expected_tokens.at(i)->getStartPos(), input);
+      ib_test_assert(tokens.at(i)->getToken() == expected_tokens.at(i)->getToken(), input);
+      ib_test_assert(tokens.at(i)->getValue() == expected_tokens.at(i)->getValue(), input);
+    }
+  }
+}
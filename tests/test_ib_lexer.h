@@ -0,0 +1,14 @@
+#ifndef __IB_TEST_LEXER_H__
+#define __IB_TEST_LEXER_H__
+void test_command_lexer_parse(ib::TestCase *c);
+void test_command_lexer_update(ib::TestCase *c);
+
+namespace ib {
+  IB_TESTCASE(Lexer)
+    void build(){
+      add(test_command_lexer_parse);
+      add(test_command_lexer_update);
+    }
+  IB_END_TESTCASE;
+}
+#endif
@@ -146,3 +146,40 @@ void test_regex_gsub_func(ib::TestCase *c) {
 
 }
 
+
+void test_regex_cache(ib::TestCase *c) {
+  ib::Regex regex1("hoge_([a-z]+)", ib::Regex::NONE);
+  regex1.init();
+  ib::Regex regex2("hoge_([a-z]+)", ib::Regex::NONE);
+  regex2.init();
+  ib_test_assert(regex1.match("hoge_foo") == 0, "");
+  ib_test_assert(regex2.match("hoge_bar") == 0, "");
+  ib_test_assert(regex1._1() == "foo", "");
+  ib_test_assert(regex2._1() == "bar", "");
+
+  ib::Regex regex3("hoge_([a-z]+)", ib::Regex::I);
+  regex3.init();
+  ib_test_assert(regex3.match("HOGE_FOO") == 0, "");
+  ib_test_assert(regex1.match("HOGE_FOO") != 0, "");
+
+  for(int i = 0; i < 2; i++) {
+    ib::Regex invalid("hoge_([a-z]+", ib::Regex::NONE);
+    std::string msg;
+    ib_test_assert(invalid.init(&msg) != 0, "");
+    ib_test_assert(!msg.empty(), "");
+  }
+}
+
+void test_regex_uncached(ib::TestCase *c) {
+  const auto size = ib::RegexCache::size();
+  ib::Regex regex("uncached_([a-z]+)", ib::Regex::NONE, false);
+  ib_test_assert(regex.init() == 0, "");
+  ib_test_assert(regex.match("uncached_foo") == 0, "");
+  ib_test_assert(regex._1() == "foo", "");
+  ib_test_assert(ib::RegexCache::size() == size, "");
+
+  ib::Regex invalid("uncached_([a-z]+", ib::Regex::NONE, false);
+  std::string msg;
+  ib_test_assert(invalid.init(&msg) != 0, "");
+  ib_test_assert(!msg.empty(), "");
+}
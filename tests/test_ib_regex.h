@@ -9,6 +9,8 @@ void test_regex_search_pos(ib::TestCase *c);
 void test_regex_split(ib::TestCase *c);
 void test_regex_gsub(ib::TestCase *c);
 void test_regex_gsub_func(ib::TestCase *c);
+void test_regex_cache(ib::TestCase *c);
+void test_regex_uncached(ib::TestCase *c);
 
 
 namespace ib {
@@ -23,6 +25,8 @@ namespace ib {
       add(test_regex_split);
       add(test_regex_gsub);
       add(test_regex_gsub_func);
+      add(test_regex_cache);
+      add(test_regex_uncached);
     }
   IB_END_TESTCASE;
 }
@@ -1,5 +1,6 @@
 #include "iceberg_tests.h"
 #include "ib_utils.h"
+#include "ib_key_bindings.h"
 #include "test_ib_utils.h"
 
 void test_expand_vars(ib::TestCase *c) {
@@ -34,3 +35,37 @@ void test_parse_key_bind(ib::TestCase *c) {
       result[2] == FL_BackSpace,
       "");
 }
+
+void test_key_bindings(ib::TestCase *c) {
+  ib::KeyBindings bindings;
+  int key_bind[3] = {};
+  ib::utils::parse_key_bind(key_bind, "ctrl-alt-d");
+  bindings.bind(key_bind, ib::KeyBindings::SHORTCUT, ":opendir");
+  memset(key_bind, 0, sizeof(key_bind));
+  ib::utils::parse_key_bind(key_bind, "escape");
+  bindings.bind(key_bind, ib::KeyBindings::ESCAPE);
+
+  const auto binding = bindings.find('d', FL_CTRL|FL_ALT);
+  ib_test_assert(binding != nullptr && binding->getAction() == ib::KeyBindings::SHORTCUT, "");
+  ib_test_assert(binding != nullptr && binding->getCommand() == ":opendir", "");
+  ib_test_assert(bindings.find('d', FL_CTRL) == nullptr, "");
+  ib_test_assert(bindings.find('d', FL_CTRL|FL_ALT|FL_SHIFT) == nullptr, "");
+  ib_test_assert(bindings.findAction(FL_Escape, 0) == ib::KeyBindings::ESCAPE, "");
+  ib_test_assert(bindings.findAction(FL_Escape, FL_CTRL) == ib::KeyBindings::NONE, "");
+}
+
+void test_spsc_queue(ib::TestCase *c) {
+  ib::SpscQueue<int, 4> queue;
+  int value = 0;
+  ib_test_assert(!queue.pop(value), "");
+  for(int i = 0; i < 4; ++i) {
+    ib_test_assert(queue.push(i), "");
+  }
+  ib_test_assert(!queue.push(4), "");
+  ib_test_assert(queue.pop(value) && value == 0, "");
+  ib_test_assert(queue.push(4), "");
+  for(int i = 1; i < 5; ++i) {
+    ib_test_assert(queue.pop(value) && value == i, "");
+  }
+  ib_test_assert(!queue.pop(value), "");
+}
@@ -2,12 +2,16 @@
 #define __IB_TEST_UTILS_H__
 void test_expand_vars(ib::TestCase *c);
 void test_parse_key_bind(ib::TestCase *c);
+void test_key_bindings(ib::TestCase *c);
+void test_spsc_queue(ib::TestCase *c);
 
 namespace ib {
   IB_TESTCASE(Utils)
     void build(){
       add(test_expand_vars);
       add(test_parse_key_bind);
+      add(test_key_bindings);
+      add(test_spsc_queue);
     }
   IB_END_TESTCASE;
 }
@@ -0,0 +1,43 @@
+// Compares ib::resize_icon with Fl_RGB_Image::copy on typical icon sizes.
+// Build and run with `make bench`.
+#include "ib_constants.h"
+#include "ib_image.h"
+
+static double elapsed_us(const std::chrono::steady_clock::time_point &start, const int count) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+int main() {
+  const int src_sizes[] = {32, 48, 64, 128, 256};
+  const int dst_sizes[] = {16, 24, 32};
+
+  printf("%-12s %12s %12s\n", "size", "copy(us)", "resize(us)");
+  for(auto src_size : src_sizes) {
+    std::vector<unsigned char> pixels(src_size * src_size * 4);
+    for(std::size_t i = 0; i < pixels.size(); ++i) {
+      pixels[i] = (unsigned char)((i * 131) % 251);
+    }
+    Fl_RGB_Image image(pixels.data(), src_size, src_size, 4);
+    for(auto dst_size : dst_sizes) {
+      if(dst_size >= src_size) continue;
+      const int count = 20000000 / (src_size * src_size) + 100;
+
+      auto start = std::chrono::steady_clock::now();
+      for(int i = 0; i < count; ++i) {
+        delete image.copy(dst_size, dst_size);
+      }
+      const auto copy_us = elapsed_us(start, count);
+
+      start = std::chrono::steady_clock::now();
+      for(int i = 0; i < count; ++i) {
+        delete ib::resize_icon(&image, dst_size);
+      }
+      const auto resize_us = elapsed_us(start, count);
+
+      char label[32];
+      snprintf(label, sizeof(label), "%d -> %d", src_size, dst_size);
+      printf("%-12s %12.2f %12.2f\n", label, copy_us, resize_us);
+    }
+  }
+  return 0;
+}